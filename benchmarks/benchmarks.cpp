@@ -0,0 +1,294 @@
+#include "hash_map.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compares hash_map with std::unordered_map on a set of workloads, key types and table sizes from a
+// few KiB (L1) to well beyond the last level cache. Prints one CSV line per measurement:
+//
+//   map,key,size,workload,ns_per_op,bytes_per_entry
+//
+// bytes_per_entry counts the memory the map itself allocated after inserting size keys without
+// reserving, i.e. excluding the characters of string keys, which are the same for every map.
+//
+// usage: benchmarks [--max-size N] [--min-time SECONDS]
+
+static std::size_t allocated_bytes = 0;
+
+template<typename T>
+struct counting_allocator
+{
+	using value_type = T;
+
+	counting_allocator() = default;
+
+	template<typename U>
+	counting_allocator(const counting_allocator<U>&) noexcept {}
+
+	T* allocate(std::size_t n)
+	{
+		allocated_bytes += n * sizeof(T);
+		return std::allocator<T>{}.allocate(n);
+	}
+
+	void deallocate(T* pointer, std::size_t n) noexcept
+	{
+		allocated_bytes -= n * sizeof(T);
+		std::allocator<T>{}.deallocate(pointer, n);
+	}
+
+	template<typename U>
+	bool operator==(const counting_allocator<U>&) const noexcept { return true; }
+
+	template<typename U>
+	bool operator!=(const counting_allocator<U>&) const noexcept { return false; }
+};
+
+template<typename Key>
+using flat_map = hash_map<Key, std::uint64_t, std::hash<Key>, std::equal_to<Key>, hash_map_probing::tombstones, hash_map_growth_policy, counting_allocator<std::pair<const Key, std::uint64_t>>>;
+
+template<typename Key>
+using robin_hood_map = hash_map<Key, std::uint64_t, std::hash<Key>, std::equal_to<Key>, hash_map_probing::robin_hood, hash_map_growth_policy, counting_allocator<std::pair<const Key, std::uint64_t>>>;
+
+template<typename Key>
+using std_map = std::unordered_map<Key, std::uint64_t, std::hash<Key>, std::equal_to<Key>, counting_allocator<std::pair<const Key, std::uint64_t>>>;
+
+struct options
+{
+	std::size_t max_size = std::size_t(1) << 22;
+	double min_time = 0.2;
+};
+
+// keys i and j are distinct for i != j; hits use i < size, misses i >= size
+template<typename Key>
+Key make_key(std::uint64_t i)
+{
+	const auto bits = hash_map_detail::mix(std::size_t(i) + 1);
+
+	if constexpr(std::is_same_v<Key, std::string>)
+	{
+		// longer than the small string buffer of common standard libraries
+		return "benchmark-key-" + std::to_string(i) + "-" + std::to_string(bits % 1000);
+	}
+	else if constexpr(sizeof(Key) == 4)
+	{
+		return Key(std::uint32_t(i) * 2654435761u);
+	}
+	else
+	{
+		return Key(bits);
+	}
+}
+
+template<typename Key>
+std::vector<Key> make_keys(std::uint64_t first, std::size_t n)
+{
+	std::vector<Key> keys{};
+	keys.reserve(n);
+
+	for(std::size_t i = 0; i < n; ++i)
+	{
+		keys.push_back(make_key<Key>(first + i));
+	}
+
+	std::shuffle(keys.begin(), keys.end(), std::mt19937_64{ first + n });
+	return keys;
+}
+
+template<typename Element>
+std::uint64_t value_of(const Element& element)
+{
+	if constexpr(hash_map_detail::is_std_pair_like<Element>::value)
+	{
+		return element.second;
+	}
+	else
+	{
+		return element.value;
+	}
+}
+
+using benchmark_clock = std::chrono::steady_clock;
+
+double seconds_since(benchmark_clock::time_point start)
+{
+	return std::chrono::duration<double>(benchmark_clock::now() - start).count();
+}
+
+// result sink so that lookups cannot be optimized away
+static volatile std::uint64_t sink = 0;
+
+void report(const char* map, const char* key, std::size_t size, const char* workload, double seconds, std::size_t operations, double bytes_per_entry)
+{
+	std::printf("%s,%s,%zu,%s,%.3f,%.2f\n", map, key, size, workload, seconds * 1e9 / double(operations), bytes_per_entry);
+	std::fflush(stdout);
+}
+
+template<typename Map>
+void run(const char* map_name, const char* key_name, const options& settings)
+{
+	using key_type = typename Map::key_type;
+
+	for(std::size_t size = 1024; size <= settings.max_size; size *= 8)
+	{
+		const auto hits = make_keys<key_type>(0, size);
+		const auto misses = make_keys<key_type>(size, size);
+
+		// insert, including growth; also measures the memory of the finished table
+		double bytes_per_entry = 0;
+		{
+			std::size_t operations = 0;
+			double seconds = 0;
+
+			do
+			{
+				const auto before = allocated_bytes;
+				const auto start = benchmark_clock::now();
+
+				Map map{};
+
+				for(std::size_t i = 0; i < hits.size(); ++i)
+				{
+					map.try_emplace(hits[i], std::uint64_t(i));
+				}
+
+				seconds += seconds_since(start);
+				operations += hits.size();
+				bytes_per_entry = double(allocated_bytes - before) / double(size);
+			} while(seconds < settings.min_time);
+
+			report(map_name, key_name, size, "insert", seconds, operations, bytes_per_entry);
+		}
+
+		Map map{};
+
+		for(std::size_t i = 0; i < hits.size(); ++i)
+		{
+			map.try_emplace(hits[i], std::uint64_t(i));
+		}
+
+		const auto measure = [&](const char* workload, std::size_t operations_per_pass, auto&& pass) {
+			std::size_t operations = 0;
+			const auto start = benchmark_clock::now();
+
+			do
+			{
+				pass();
+				operations += operations_per_pass;
+			} while(seconds_since(start) < settings.min_time);
+
+			report(map_name, key_name, size, workload, seconds_since(start), operations, bytes_per_entry);
+		};
+
+		measure("find_hit", size, [&] {
+			std::uint64_t sum = 0;
+
+			for(const auto& key : hits)
+			{
+				sum += value_of(*map.find(key));
+			}
+
+			sink = sink + sum;
+		});
+
+		measure("find_miss", size, [&] {
+			std::uint64_t found = 0;
+
+			for(const auto& key : misses)
+			{
+				found += map.find(key) != map.end();
+			}
+
+			sink = sink + found;
+		});
+
+		// every key is erased and inserted again, one erase or insert counts as one operation
+		measure("churn", 2 * size, [&] {
+			for(std::size_t i = 0; i < hits.size(); ++i)
+			{
+				map.erase(hits[i]);
+				map.try_emplace(hits[i], std::uint64_t(i));
+			}
+		});
+
+		measure("iterate", size, [&] {
+			std::uint64_t sum = 0;
+
+			for(const auto& element : map)
+			{
+				sum += value_of(element);
+			}
+
+			sink = sink + sum;
+		});
+
+		// rebuilding a full table at twice its size, per element
+		{
+			std::size_t operations = 0;
+			double seconds = 0;
+
+			do
+			{
+				auto copy = map;
+				const auto start = benchmark_clock::now();
+
+				if constexpr(std::is_same_v<Map, std_map<key_type>>)
+				{
+					copy.rehash(copy.bucket_count() * 2);
+				}
+				else
+				{
+					copy.rehash(copy.capacity() * 2);
+				}
+
+				seconds += seconds_since(start);
+				operations += size;
+			} while(seconds < settings.min_time);
+
+			report(map_name, key_name, size, "rehash", seconds, operations, bytes_per_entry);
+		}
+	}
+}
+
+template<typename Key>
+void run_all(const char* key_name, const options& settings)
+{
+	run<flat_map<Key>>("hash_map", key_name, settings);
+	run<robin_hood_map<Key>>("hash_map_robin_hood", key_name, settings);
+	run<std_map<Key>>("std::unordered_map", key_name, settings);
+}
+
+int main(int argc, char** argv)
+{
+	options settings{};
+
+	for(int i = 1; i < argc; i += 2)
+	{
+		if(i + 1 < argc && std::strcmp(argv[i], "--max-size") == 0)
+		{
+			settings.max_size = std::size_t(std::strtoull(argv[i + 1], nullptr, 10));
+		}
+		else if(i + 1 < argc && std::strcmp(argv[i], "--min-time") == 0)
+		{
+			settings.min_time = std::strtod(argv[i + 1], nullptr);
+		}
+		else
+		{
+			std::fprintf(stderr, "usage: %s [--max-size N] [--min-time SECONDS]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	std::printf("map,key,size,workload,ns_per_op,bytes_per_entry\n");
+
+	run_all<std::uint32_t>("uint32", settings);
+	run_all<std::uint64_t>("uint64", settings);
+	run_all<std::string>("string", settings);
+}
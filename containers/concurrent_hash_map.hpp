@@ -0,0 +1,238 @@
+#pragma once
+
+#include "hash_map.hpp"
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+// Thread-safe hash map that splits the keyspace into a power of two number of shards. Every shard
+// is a hash_map with its own reader/writer lock and grows independently, so threads working on
+// different shards never wait for each other. The shard of a key is chosen by the top bits of its
+// hash, the shard's own table uses the low bits; the key is hashed once and the hash handed to the
+// shard's map along with it.
+//
+// No references into the map are handed out: lookups return copies, and visit(), upsert() and
+// for_each() run a function on an element while its shard is locked. Such functions must not call
+// back into the same map.
+template<
+	typename Key,
+	typename Value,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>,
+	typename Probing = hash_map_probing::tombstones,
+	typename GrowthPolicy = hash_map_growth_policy,
+	typename Allocator = std::allocator<std::pair<const Key, Value>>>
+class concurrent_hash_map
+{
+public:
+	using map_type = hash_map<Key, Value, Hash, KeyEqual, Probing, GrowthPolicy, Allocator>;
+	using key_type = Key;
+	using value_type = Value;
+	using key_value_pair = typename map_type::key_value_pair;
+	using size_type = typename map_type::size_type;
+
+private:
+	// shards sit on their own cache lines so that their locks do not share one
+	struct alignas(64) shard
+	{
+		mutable std::shared_mutex lock;
+		map_type map;
+	};
+
+	std::vector<shard> shards;
+	unsigned shard_shift;
+	Hash hash{};
+
+public:
+	concurrent_hash_map()
+		: concurrent_hash_map(default_shard_count()) { }
+
+	// shard_count is rounded up to a power of two
+	explicit concurrent_hash_map(size_type shard_count)
+		: shards(hash_map_detail::next_power_of_two(std::max<size_type>(shard_count, 1))),
+		  shard_shift(unsigned(std::numeric_limits<std::size_t>::digits - std::max(1u, hash_map_detail::trailing_zeros(shards.size()))))
+	{
+	}
+
+	concurrent_hash_map(const concurrent_hash_map&) = delete;
+	concurrent_hash_map& operator=(const concurrent_hash_map&) = delete;
+
+	// lookup
+
+	// copy of the value of key, if there is one
+	std::optional<value_type> find(const key_type& key) const
+	{
+		const auto key_hash = hash_of(key);
+		const auto& target = shard_of(key_hash);
+		std::shared_lock<std::shared_mutex> guard{ target.lock };
+
+		const auto iter = target.map.find(key, key_hash);
+		if(iter == target.map.end()) return std::nullopt;
+
+		return iter->value;
+	}
+
+	bool contains(const key_type& key) const
+	{
+		const auto key_hash = hash_of(key);
+		const auto& target = shard_of(key_hash);
+		std::shared_lock<std::shared_mutex> guard{ target.lock };
+
+		return target.map.contains(key, key_hash);
+	}
+
+	// calls fn with the value of key under a shared lock, returns whether key was found
+	template<typename F>
+	bool visit(const key_type& key, F&& fn) const
+	{
+		const auto key_hash = hash_of(key);
+		const auto& target = shard_of(key_hash);
+		std::shared_lock<std::shared_mutex> guard{ target.lock };
+
+		const auto iter = target.map.find(key, key_hash);
+		if(iter == target.map.end()) return false;
+
+		std::forward<F>(fn)(static_cast<const value_type&>(iter->value));
+		return true;
+	}
+
+	// calls fn with a modifiable value of key under an exclusive lock, returns whether key was found
+	template<typename F>
+	bool visit(const key_type& key, F&& fn)
+	{
+		const auto key_hash = hash_of(key);
+		auto& target = shard_of(key_hash);
+		std::unique_lock<std::shared_mutex> guard{ target.lock };
+
+		const auto iter = target.map.find(key, key_hash);
+		if(iter == target.map.end()) return false;
+
+		std::forward<F>(fn)(iter->value);
+		return true;
+	}
+
+	// calls fn with every element, one shard at a time; elements inserted or erased meanwhile in
+	// other shards may or may not be visited
+	template<typename F>
+	void for_each(F&& fn) const
+	{
+		for(const auto& target : shards)
+		{
+			std::shared_lock<std::shared_mutex> guard{ target.lock };
+
+			for(const auto& element : target.map)
+			{
+				fn(element);
+			}
+		}
+	}
+
+	// mutators
+
+	// inserts key or replaces its value, like hash_map::insert(); returns whether key was new
+	template<typename K, typename V>
+	bool insert(K&& key, V&& value)
+	{
+		const auto key_hash = hash_of(key);
+		auto& target = shard_of(key_hash);
+		std::unique_lock<std::shared_mutex> guard{ target.lock };
+
+		return target.map.insert_or_assign_hashed(key_hash, std::forward<K>(key), std::forward<V>(value)).second;
+	}
+
+	// inserts key with a value constructed from args unless it exists; returns whether it was new
+	template<typename K, typename... Args>
+	bool try_emplace(K&& key, Args&&... args)
+	{
+		const auto key_hash = hash_of(key);
+		auto& target = shard_of(key_hash);
+		std::unique_lock<std::shared_mutex> guard{ target.lock };
+
+		return target.map.try_emplace_hashed(key_hash, std::forward<K>(key), std::forward<Args>(args)...).second;
+	}
+
+	// calls fn with the value of key under an exclusive lock, constructing the value from args first
+	// if key is missing; returns whether key was new
+	template<typename K, typename F, typename... Args>
+	bool upsert(K&& key, F&& fn, Args&&... args)
+	{
+		const auto key_hash = hash_of(key);
+		auto& target = shard_of(key_hash);
+		std::unique_lock<std::shared_mutex> guard{ target.lock };
+
+		const auto [iter, inserted] = target.map.try_emplace_hashed(key_hash, std::forward<K>(key), std::forward<Args>(args)...);
+		std::forward<F>(fn)(iter->value);
+
+		return inserted;
+	}
+
+	// returns whether key was erased
+	bool erase(const key_type& key)
+	{
+		const auto key_hash = hash_of(key);
+		auto& target = shard_of(key_hash);
+		std::unique_lock<std::shared_mutex> guard{ target.lock };
+
+		const auto iter = target.map.find(key, key_hash);
+		if(iter == target.map.end()) return false;
+
+		target.map.erase(iter);
+		return true;
+	}
+
+	void clear()
+	{
+		for(auto& target : shards)
+		{
+			std::unique_lock<std::shared_mutex> guard{ target.lock };
+			target.map = map_type{ 0, target.map.growth_policy(), target.map.get_allocator() };
+		}
+	}
+
+	// makes room for n elements, assuming they spread evenly over the shards
+	void reserve(size_type n)
+	{
+		const auto per_shard = (n + shards.size() - 1) / shards.size();
+
+		for(auto& target : shards)
+		{
+			std::unique_lock<std::shared_mutex> guard{ target.lock };
+			target.map.reserve(per_shard);
+		}
+	}
+
+	// queries
+
+	// sum of the shard sizes, which is only exact if no other thread modifies the map meanwhile
+	size_type size() const
+	{
+		size_type result = 0;
+
+		for(const auto& target : shards)
+		{
+			std::shared_lock<std::shared_mutex> guard{ target.lock };
+			result += target.map.size();
+		}
+
+		return result;
+	}
+
+	bool empty() const { return size() == 0; }
+	size_type shard_count() const noexcept { return shards.size(); }
+
+private:
+	static size_type default_shard_count() noexcept
+	{
+		return 4 * std::max<size_type>(std::thread::hardware_concurrency(), 1);
+	}
+
+	// the shards' maps hash with a default constructed Hash as well, so this is the hash they would compute
+	template<typename K>
+	std::size_t hash_of(const K& key) const noexcept { return hash_map_detail::hash_key(hash, key); }
+
+	shard& shard_of(std::size_t key_hash) noexcept { return shards[(key_hash >> shard_shift) & (shards.size() - 1)]; }
+	const shard& shard_of(std::size_t key_hash) const noexcept { return shards[(key_hash >> shard_shift) & (shards.size() - 1)]; }
+};
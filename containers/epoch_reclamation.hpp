@@ -0,0 +1,208 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+// Epoch-based reclamation: memory that readers might still be looking at is retired instead of
+// freed, and only freed once every reader that was active at the time has left its critical
+// section. Readers announce themselves by storing the current epoch in a participant record of
+// their own (on its own cache line) and never write any other shared memory.
+//
+// There is one process-wide domain. A thread claims a participant record on its first read and
+// gives it back when it exits.
+class epoch_domain
+{
+private:
+	static constexpr std::uint64_t inactive = 0;
+
+	struct alignas(64) participant
+	{
+		std::atomic<std::uint64_t> epoch{ inactive };
+		std::atomic<bool> claimed{ false };
+	};
+
+	struct retired_item
+	{
+		std::uint64_t epoch;
+		void* pointer;
+		void (*deleter)(void*);
+	};
+
+	// a thread's claim on a participant record, released when the thread exits
+	struct local_record
+	{
+		participant* slot = nullptr;
+		unsigned depth = 0;
+
+		~local_record()
+		{
+			if(slot != nullptr) slot->claimed.store(false, std::memory_order_release);
+		}
+	};
+
+public:
+	// maximum number of threads that can be inside read sections at the same time
+	static constexpr std::size_t max_participants = 1024;
+
+	static epoch_domain& instance()
+	{
+		static epoch_domain domain{};
+		return domain;
+	}
+
+	epoch_domain(const epoch_domain&) = delete;
+	epoch_domain& operator=(const epoch_domain&) = delete;
+
+	~epoch_domain()
+	{
+		// no reader can be active anymore during static destruction
+		for(const auto& item : retired)
+		{
+			item.deleter(item.pointer);
+		}
+	}
+
+	// read section; memory that was reachable when it started stays valid until it ends. Read
+	// sections of the same thread can be nested.
+	class guard
+	{
+	public:
+		guard()
+			: record(instance().local_participant())
+		{
+			if(record.depth++ == 0)
+			{
+				record.slot->epoch.store(instance().global_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+			}
+		}
+
+		guard(const guard&) = delete;
+		guard& operator=(const guard&) = delete;
+
+		~guard()
+		{
+			if(--record.depth == 0) record.slot->epoch.store(inactive, std::memory_order_release);
+		}
+
+	private:
+		local_record& record;
+	};
+
+	// frees pointer with deleter once no read section that might still see it is active; the
+	// caller has to have made it unreachable (with a seq_cst store) before
+	template<typename T>
+	void retire(T* pointer)
+	{
+		retire(pointer, [](void* erased) { delete static_cast<T*>(erased); });
+	}
+
+	void retire(void* pointer, void (*deleter)(void*))
+	{
+		std::vector<retired_item> reclaimable{};
+
+		{
+			std::lock_guard<std::mutex> lock{ retired_lock };
+
+			retired.push_back({ global_epoch.fetch_add(1, std::memory_order_seq_cst), pointer, deleter });
+			collect(reclaimable);
+		}
+
+		for(const auto& item : reclaimable)
+		{
+			item.deleter(item.pointer);
+		}
+	}
+
+	// frees everything retired before that is no longer visible to any reader
+	void reclaim()
+	{
+		std::vector<retired_item> reclaimable{};
+
+		{
+			std::lock_guard<std::mutex> lock{ retired_lock };
+
+			global_epoch.fetch_add(1, std::memory_order_seq_cst);
+			collect(reclaimable);
+		}
+
+		for(const auto& item : reclaimable)
+		{
+			item.deleter(item.pointer);
+		}
+	}
+
+	std::size_t pending() const
+	{
+		std::lock_guard<std::mutex> lock{ retired_lock };
+		return retired.size();
+	}
+
+private:
+	std::atomic<std::uint64_t> global_epoch{ 1 };
+	participant participants[max_participants];
+	std::atomic<std::size_t> participants_used{ 0 }; // records at this index and above were never claimed
+
+	mutable std::mutex retired_lock;
+	std::vector<retired_item> retired;
+
+	epoch_domain() = default;
+
+	local_record& local_participant()
+	{
+		thread_local local_record record{};
+
+		if(record.slot == nullptr)
+		{
+			for(std::size_t index = 0; index < max_participants; ++index)
+			{
+				auto& candidate = participants[index];
+
+				if(!candidate.claimed.load(std::memory_order_relaxed) && !candidate.claimed.exchange(true, std::memory_order_acquire))
+				{
+					auto used = participants_used.load(std::memory_order_seq_cst);
+					while(used <= index && !participants_used.compare_exchange_weak(used, index + 1, std::memory_order_seq_cst)) {}
+
+					record.slot = &candidate;
+					break;
+				}
+			}
+
+			if(record.slot == nullptr) throw std::runtime_error{ "too many threads in epoch read sections" };
+		}
+
+		return record;
+	}
+
+	// moves every item retired before the oldest active read section started to reclaimable
+	void collect(std::vector<retired_item>& reclaimable)
+	{
+		auto oldest = global_epoch.load(std::memory_order_seq_cst);
+
+		const auto used = participants_used.load(std::memory_order_seq_cst);
+
+		for(std::size_t index = 0; index < used; ++index)
+		{
+			const auto epoch = participants[index].epoch.load(std::memory_order_seq_cst);
+			if(epoch != inactive && epoch < oldest) oldest = epoch;
+		}
+
+		auto kept = retired.begin();
+
+		for(auto& item : retired)
+		{
+			if(item.epoch < oldest)
+			{
+				reclaimable.push_back(item);
+			}
+			else
+			{
+				*kept++ = item;
+			}
+		}
+
+		retired.erase(kept, retired.end());
+	}
+};
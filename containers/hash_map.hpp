@@ -3,70 +3,618 @@
 #include <vector>
 #include <iterator>
 #include <type_traits>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <limits>
+#include <cstring>
+#include <new>
+#include <cmath>
+#include <utility>
+#include <initializer_list>
+#include <memory>
+#include <memory_resource>
+#include <exception>
+#include <thread>
+
+#if !defined(HASH_MAP_NO_SIMD)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define HASH_MAP_GROUP_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HASH_MAP_GROUP_SSE2
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace hash_map_detail
+{
+	// Control bytes describe the state of one slot each. A full slot stores the low 7 bits of the
+	// hash of its key (the "tag"), so a whole group of slots can be matched against a tag at once.
+	using ctrl_type = std::int8_t;
+
+	static constexpr ctrl_type ctrl_empty = -128;  // 0b10000000
+	static constexpr ctrl_type ctrl_deleted = -2;  // 0b11111110
+
+	inline ctrl_type tag_of(std::size_t hash) noexcept { return static_cast<ctrl_type>(hash & 0x7F); }
+	inline bool is_full(ctrl_type ctrl) noexcept { return ctrl >= 0; }
+
+	// finalizer (from MurmurHash3) so that weak hashes like the identity std::hash<int> still
+	// spread over both the tag bits and the group index bits
+	inline std::size_t mix(std::size_t hash) noexcept
+	{
+		if constexpr(sizeof(std::size_t) == 8)
+		{
+			auto h = static_cast<std::uint64_t>(hash);
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdull;
+			h ^= h >> 33;
+			h *= 0xc4ceb9fe1a85ec53ull;
+			h ^= h >> 33;
+			return static_cast<std::size_t>(h);
+		}
+		else
+		{
+			auto h = static_cast<std::uint32_t>(hash);
+			h ^= h >> 16;
+			h *= 0x85ebca6bu;
+			h ^= h >> 13;
+			h *= 0xc2b2ae35u;
+			h ^= h >> 16;
+			return static_cast<std::size_t>(h);
+		}
+	}
+
+	// hashers that already produce well distributed bits can opt out of the mixing step by
+	// declaring a member type is_avalanching
+	template<typename Hash, typename = void>
+	struct is_avalanching : std::false_type {};
+
+	template<typename Hash>
+	struct is_avalanching<Hash, std::void_t<typename Hash::is_avalanching>> : std::true_type {};
+
+	// hash of key as the tables use it
+	template<typename Hash, typename K>
+	std::size_t hash_key(const Hash& hasher, const K& key) noexcept
+	{
+		if constexpr(is_avalanching<Hash>::value)
+		{
+			return hasher(key);
+		}
+		else
+		{
+			return mix(hasher(key));
+		}
+	}
+
+	// full hash of a slot's key, if the map stores them (the empty specialization keeps slots small)
+	template<bool Stored>
+	struct stored_hash
+	{
+		std::size_t hash;
+
+		void store(std::size_t key_hash) noexcept { hash = key_hash; }
+		bool matches(std::size_t key_hash) const noexcept { return hash == key_hash; }
+	};
+
+	template<>
+	struct stored_hash<false>
+	{
+		void store(std::size_t) noexcept {}
+		bool matches(std::size_t) const noexcept { return true; }
+	};
+
+	// hashers declaring a member type is_transparent can hash types other than the key type, which
+	// enables lookups by e.g. std::string_view in a map with std::string keys
+	template<typename Hash, typename = void>
+	struct is_transparent : std::false_type {};
+
+	template<typename Hash>
+	struct is_transparent<Hash, std::void_t<typename Hash::is_transparent>> : std::true_type {};
+
+	template<typename It, typename = void>
+	struct is_iterator : std::false_type {};
+
+	template<typename It>
+	struct is_iterator<It, std::void_t<typename std::iterator_traits<It>::iterator_category>> : std::true_type {};
+
+	template<typename It>
+	constexpr bool is_forward_iterator = std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<It>::iterator_category>;
+
+	// ranges can hold std::pairs as well as the map's own key_value_pairs
+	template<typename T, typename = void>
+	struct is_std_pair_like : std::false_type {};
+
+	template<typename T>
+	struct is_std_pair_like<T, std::void_t<decltype(std::declval<T>().first), decltype(std::declval<T>().second)>> : std::true_type {};
+
+	inline void prefetch(const void* address) noexcept
+	{
+#if defined(HASH_MAP_GROUP_AVX2) || defined(HASH_MAP_GROUP_SSE2)
+		_mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__)
+		__builtin_prefetch(address);
+#else
+		(void)address;
+#endif
+	}
+
+	// atomic accesses to single bytes of a plain control array, for tables that several threads fill
+	// at once (C++17 has no std::atomic_ref)
+	inline ctrl_type load_relaxed(const ctrl_type* ctrl) noexcept
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		return static_cast<ctrl_type>(__iso_volatile_load8(reinterpret_cast<const volatile char*>(ctrl)));
+#else
+		return __atomic_load_n(ctrl, __ATOMIC_RELAXED);
+#endif
+	}
+
+	// replaces an empty control byte with desired, returns false if another thread claimed it first
+	inline bool claim_empty(ctrl_type* ctrl, ctrl_type desired) noexcept
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		return _InterlockedCompareExchange8(reinterpret_cast<volatile char*>(ctrl), char(desired), char(ctrl_empty)) == char(ctrl_empty);
+#else
+		auto expected = ctrl_empty;
+		return __atomic_compare_exchange_n(ctrl, &expected, desired, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+#endif
+	}
+
+	// runs task(0) ... task(tasks - 1) on a thread each, the calling thread included; tasks that no
+	// thread can be started for run on the calling thread
+	struct thread_per_task
+	{
+		template<typename Task>
+		void operator()(std::size_t tasks, const Task& task) const noexcept
+		{
+			std::vector<std::thread> workers{};
+			std::size_t started = 1;
+
+			try
+			{
+				workers.reserve(tasks - 1);
+				for(; started < tasks; ++started) workers.emplace_back([&task, started] { task(started); });
+			}
+			catch(...)
+			{
+			}
+
+			task(0);
+			for(auto index = started; index < tasks; ++index) task(index);
+
+			for(auto& worker : workers) worker.join();
+		}
+	};
+
+	// Allocators that can resize a block without copying it (e.g. huge_page_allocator, with mremap)
+	// provide T* reallocate(T* pointer, std::size_t n, std::size_t new_n) noexcept. It returns the
+	// block, possibly at a new address, with the first n elements kept, or nullptr if it cannot
+	// resize the block, which then stays as it is.
+	template<typename Alloc, typename = void>
+	struct can_reallocate : std::false_type {};
+
+	template<typename Alloc>
+	struct can_reallocate<Alloc, std::void_t<decltype(std::declval<Alloc&>().reallocate(std::declval<typename Alloc::value_type*>(), std::size_t{}, std::size_t{}))>> : std::true_type {};
+
+	// Fixed size array of the slots or control bytes of a table. Unlike a std::vector it can let an
+	// allocator with reallocate() grow its block in place. Elements are default initialized (slots
+	// stay uninitialized until the control bytes mark them full) and never destroyed. Moving and
+	// swapping require allocators that compare equal unless they propagate, like for std::vector.
+	template<typename T, typename Alloc>
+	class table_array
+	{
+		using traits = std::allocator_traits<Alloc>;
+
+		static_assert(std::is_trivially_destructible_v<T>, "elements are never destroyed");
+		static_assert(std::is_same_v<typename traits::pointer, T*>, "blocks are handled through plain pointers");
+
+	public:
+		using value_type = T;
+		using size_type = std::size_t;
+		using allocator_type = Alloc;
+
+		explicit table_array(const Alloc& alloc) noexcept
+			: allocator(alloc) {}
+
+		table_array(size_type n, const Alloc& alloc)
+			: allocator(alloc),
+			  elements(n == 0 ? nullptr : traits::allocate(allocator, n)),
+			  length(n)
+		{
+			std::uninitialized_default_construct_n(elements, n);
+		}
+
+		table_array(size_type n, const T& value, const Alloc& alloc)
+			: table_array(n, alloc)
+		{
+			std::fill_n(elements, n, value);
+		}
+
+		table_array(table_array&& other) noexcept
+			: allocator(other.allocator),
+			  elements(std::exchange(other.elements, nullptr)),
+			  length(std::exchange(other.length, 0)) {}
+
+		table_array& operator=(table_array&& other) noexcept
+		{
+			if(this != &other)
+			{
+				release();
+
+				if constexpr(traits::propagate_on_container_move_assignment::value) allocator = other.allocator;
+				elements = std::exchange(other.elements, nullptr);
+				length = std::exchange(other.length, 0);
+			}
+
+			return *this;
+		}
+
+		~table_array() { release(); }
+
+		friend void swap(table_array& first, table_array& second) noexcept
+		{
+			using std::swap;
+
+			if constexpr(traits::propagate_on_container_swap::value) swap(first.allocator, second.allocator);
+			swap(first.elements, second.elements);
+			swap(first.length, second.length);
+		}
+
+		// grows the array to n elements without copying it, if the allocator can; the new elements
+		// are default initialized. Returns false, with the array unchanged, otherwise.
+		bool grow_in_place(size_type n) noexcept
+		{
+			if constexpr(can_reallocate<Alloc>::value)
+			{
+				if(length == 0 || n <= length) return false;
+
+				if(const auto resized = allocator.reallocate(elements, length, n))
+				{
+					std::uninitialized_default_construct(resized + length, resized + n);
+					elements = resized;
+					length = n;
+					return true;
+				}
+			}
+
+			(void)n;
+			return false;
+		}
+
+		T& operator[](size_type index) noexcept { return elements[index]; }
+		const T& operator[](size_type index) const noexcept { return elements[index]; }
+
+		T* data() noexcept { return elements; }
+		const T* data() const noexcept { return elements; }
+
+		T* begin() noexcept { return elements; }
+		const T* begin() const noexcept { return elements; }
+		T* end() noexcept { return elements + length; }
+		const T* end() const noexcept { return elements + length; }
+
+		size_type size() const noexcept { return length; }
+		bool empty() const noexcept { return length == 0; }
+
+		Alloc get_allocator() const noexcept { return allocator; }
+
+	private:
+		Alloc allocator;
+		T* elements = nullptr;
+		size_type length = 0;
+
+		void release() noexcept
+		{
+			if(elements != nullptr) traits::deallocate(allocator, elements, length);
+		}
+	};
+
+	// smallest power of two that is at least value; throws std::length_error if there is none
+	inline std::size_t next_power_of_two(std::size_t value)
+	{
+		constexpr auto largest = (std::numeric_limits<std::size_t>::max() >> 1) + 1;
+		if(value > largest) throw std::length_error{ "no power of two is large enough" };
+
+		std::size_t result = 1;
+		while(result < value) result <<= 1;
+		return result;
+	}
+
+	inline unsigned trailing_zeros(std::uint64_t value) noexcept
+	{
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return index;
+#elif defined(_MSC_VER)
+		unsigned long index;
+		if(_BitScanForward(&index, static_cast<std::uint32_t>(value))) return index;
+		_BitScanForward(&index, static_cast<std::uint32_t>(value >> 32));
+		return index + 32;
+#else
+		return static_cast<unsigned>(__builtin_ctzll(value));
+#endif
+	}
+
+	// set of matching slot indices within a group, one bit (or byte for Shift == 3) per slot
+	template<typename T, unsigned Shift>
+	class bitmask
+	{
+		T mask;
+
+	public:
+		explicit bitmask(T bits) noexcept
+			: mask(bits) {}
+
+		explicit operator bool() const noexcept { return mask != 0; }
+
+		unsigned lowest() const noexcept { return trailing_zeros(mask) >> Shift; }
+
+		bitmask& operator++() noexcept
+		{
+			mask &= mask - 1;
+			return *this;
+		}
+
+		unsigned operator*() const noexcept { return lowest(); }
+
+		bitmask begin() const noexcept { return *this; }
+		bitmask end() const noexcept { return bitmask{ 0 }; }
+
+		bool operator==(const bitmask& other) const noexcept { return mask == other.mask; }
+		bool operator!=(const bitmask& other) const noexcept { return mask != other.mask; }
+	};
+
+#if defined(HASH_MAP_GROUP_AVX2)
+	struct group
+	{
+		static constexpr std::size_t width = 32;
+
+		using mask_type = bitmask<std::uint32_t, 0>;
+
+		__m256i ctrl;
+
+		explicit group(const ctrl_type* pos) noexcept
+			: ctrl(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos))) {}
+
+		mask_type match(ctrl_type tag) const noexcept
+		{
+			return mask_type{ static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(tag), ctrl))) };
+		}
+
+		mask_type match_empty() const noexcept { return match(ctrl_empty); }
 
-template<typename Key, typename Value, typename Hash = std::hash<Key>>
+		mask_type match_empty_or_deleted() const noexcept
+		{
+			return mask_type{ static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_set1_epi8(-1), ctrl))) };
+		}
+
+		mask_type match_full() const noexcept
+		{
+			return mask_type{ ~static_cast<std::uint32_t>(_mm256_movemask_epi8(ctrl)) };
+		}
+	};
+#elif defined(HASH_MAP_GROUP_SSE2)
+	struct group
+	{
+		static constexpr std::size_t width = 16;
+
+		using mask_type = bitmask<std::uint32_t, 0>;
+
+		__m128i ctrl;
+
+		explicit group(const ctrl_type* pos) noexcept
+			: ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+
+		mask_type match(ctrl_type tag) const noexcept
+		{
+			return mask_type{ static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), ctrl))) };
+		}
+
+		mask_type match_empty() const noexcept { return match(ctrl_empty); }
+
+		mask_type match_empty_or_deleted() const noexcept
+		{
+			return mask_type{ static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl))) };
+		}
+
+		mask_type match_full() const noexcept
+		{
+			return mask_type{ static_cast<std::uint32_t>(_mm_movemask_epi8(ctrl)) ^ 0xFFFFu };
+		}
+	};
+#else
+	// portable fallback: treats 8 control bytes as one 64 bit word
+	struct group
+	{
+		static constexpr std::size_t width = 8;
+
+		using mask_type = bitmask<std::uint64_t, 3>;
+
+		static constexpr std::uint64_t lsbs = 0x0101010101010101ull;
+		static constexpr std::uint64_t msbs = 0x8080808080808080ull;
+
+		std::uint64_t ctrl;
+
+		explicit group(const ctrl_type* pos) noexcept
+		{
+			std::memcpy(&ctrl, pos, sizeof(ctrl));
+		}
+
+		// may report false positives, but only for full slots (the key comparison sorts those out)
+		mask_type match(ctrl_type tag) const noexcept
+		{
+			const auto x = ctrl ^ (lsbs * static_cast<std::uint8_t>(tag));
+			return mask_type{ (x - lsbs) & ~x & msbs };
+		}
+
+		mask_type match_empty() const noexcept { return mask_type{ ctrl & ~(ctrl << 6) & msbs }; }
+		mask_type match_empty_or_deleted() const noexcept { return mask_type{ ctrl & ~(ctrl << 7) & msbs }; }
+		mask_type match_full() const noexcept { return mask_type{ ~ctrl & msbs }; }
+	};
+#endif
+}
+
+namespace hash_map_probing
+{
+	// erase() leaves a tombstone whenever the erased slot's group has no empty slot left
+	struct tombstones {};
+
+	// elements that are further away from their home group take precedence over less displaced
+	// ones on insertion, which keeps probe lengths even; erase() shifts displaced elements back
+	// instead of leaving tombstones (and thereby invalidates iterators)
+	struct robin_hood {};
+}
+
+// What hash_map::build_parallel() does with an element whose key is already in the map (or earlier
+// in the input); any function of (value_type& existing, const value_type& duplicate) can combine them.
+namespace hash_map_duplicates
+{
+	// the value inserted first stays
+	struct keep_first
+	{
+		template<typename Value, typename Duplicate>
+		void operator()(Value&, const Duplicate&) const noexcept {}
+	};
+
+	// the value inserted last wins, like with insert()
+	struct keep_last
+	{
+		template<typename Value, typename Duplicate>
+		void operator()(Value& existing, const Duplicate& duplicate) const { existing = duplicate; }
+	};
+}
+
+// Whether hash_map stores the full hash next to each key. Lookups then compare hashes before keys,
+// and growing or purging the table does not need to hash any key again. Enabled by default for keys
+// that are not trivially copyable (e.g. std::string), can be specialized for any key type.
+template<typename Key>
+struct hash_map_store_hash : std::bool_constant<!std::is_trivially_copyable_v<Key>> {};
+
+// Controls when and by how much hash_map grows or shrinks. Custom policies are best derived from
+// this one, changing the defaults in their constructor.
+struct hash_map_growth_policy
+{
+	double max_load_factor = 0.5;     // an insert that would exceed this load (tombstones included) grows the table; < 1
+	double growth_factor = 2.0;       // capacity multiplier on growth, rounded up to a power of two; > 1
+	std::size_t min_capacity = 16;    // initial capacity, the table never shrinks below it
+	double shrink_load_factor = 0.0;  // erase() shrinks the table once the load drops below this; 0 disables shrinking
+	std::size_t incremental_step = 0; // slots migrated per operation when growing incrementally; 0 rehashes all at once
+	std::size_t rehash_threads = 1;   // threads that rehash large tables on growth and reserve(); 1 rehashes on the calling thread
+
+	void validate() const
+	{
+		if(!(max_load_factor > 0.0 && max_load_factor < 1.0)) throw std::invalid_argument{ "max load factor has to be in (0, 1)" };
+		if(!(growth_factor > 1.0)) throw std::invalid_argument{ "growth factor has to be greater than 1" };
+		if(!(shrink_load_factor >= 0.0 && shrink_load_factor < max_load_factor / 2)) throw std::invalid_argument{ "shrink load factor has to be in [0, max load factor / 2)" };
+	}
+};
+
+// Layout of a hash_map's table as reported by hash_map::stats(), e.g. to spot weak hashers (long
+// probe distances, long clusters) or tables degraded by tombstones. Distances are counted in groups
+// since lookups probe whole groups at once; while growing incrementally, the elements and clusters
+// of the previous table are included.
+struct hash_map_stats
+{
+	std::size_t size = 0;
+	std::size_t capacity = 0;
+	std::size_t tombstones = 0;
+	double load_factor = 0.0;           // size / capacity
+	double effective_load_factor = 0.0; // (size + tombstones) / capacity, what lookups of missing keys feel
+	std::vector<std::size_t> probe_histogram{}; // [d] = elements that are d groups away from their home group
+	double mean_probe_distance = 0.0;
+	std::size_t longest_cluster = 0;    // longest run of slots without an empty one (full or deleted)
+	std::size_t allocated_bytes = 0;    // slots and control bytes of all tables
+	double bytes_per_element = 0.0;
+};
+
+// read-only view of a hash_map snapshot, see hash_map_snapshot.hpp
+template<typename Map>
+class hash_map_view;
+
+template<
+	typename Key,
+	typename Value,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>,
+	typename Probing = hash_map_probing::tombstones,
+	typename GrowthPolicy = hash_map_growth_policy,
+	typename Allocator = std::allocator<std::pair<const Key, Value>>>
 class hash_map
 {
+	template<typename Map>
+	friend class hash_map_view;
+
 public:
 	using key_type = Key;
 	using value_type = Value;
+	using hasher = Hash;
+	using key_equal = KeyEqual;
+	using allocator_type = Allocator;
 
 	struct key_value_pair
 	{
 		key_type key;
 		value_type value;
 
-		template<typename... Args, typename = std::enable_if_t<std::is_constructible_v<T, Args&&...>>>
-		key_value_pair(key_type key, Args&&... args) noexcept(std::is_nothrow_constructible_v<value_type, Args&&...>)
-			: key{ key },
+		template<
+			typename K,
+			typename... Args,
+			typename = std::enable_if_t<std::is_constructible_v<key_type, K&&> && std::is_constructible_v<value_type, Args&&...>>>
+		key_value_pair(K&& key, Args&&... args) noexcept(std::is_nothrow_constructible_v<key_type, K&&> && std::is_nothrow_constructible_v<value_type, Args&&...>)
+			: key{ std::forward<K>(key) },
 			  value{ std::forward<Args>(args)... } {}
 	};
 
 private:
-	struct slot_type
-	{
-		using state_type = std::int8_t;
+	static constexpr bool store_hash = hash_map_store_hash<key_type>::value;
 
-		static constexpr state_type none = 0;
-		static constexpr state_type empty = 1;
-		static constexpr state_type full = 2;
-		static constexpr state_type deleted = 4;
+	using hash_field = hash_map_detail::stored_hash<store_hash>;
 
-		std::aligned_storage_t<sizeof(key_value_pair), alignof(key_value_pair)> content{};
-		state_type state = empty;
+	// raw payload of a slot; whether it holds a live key_value_pair is tracked by its control byte
+	struct slot_type : hash_field
+	{
+		std::aligned_storage_t<sizeof(key_value_pair), alignof(key_value_pair)> content;
 
-		slot_type() = default;
-		slot_type(slot_type&& other) noexcept = default;
-		slot_type(const slot_type& other) = default;
-		~slot_type() noexcept(std::is_nothrow_destructible_v<key_type> && std::is_nothrow_destructible_v<value_type>)
+		template<typename K, typename... Args>
+		void set(K&& key, Args&&... args)
 		{
-			if(state == full)
-			{
-				release();
-			}
+			new(&content) key_value_pair(std::forward<K>(key), std::forward<Args>(args)...);
 		}
 
-		template<typename... Args>
-		void set(hash_map::key_type key, Args&&... args)
+		// move constructs the element (and stored hash) of other into this slot and destroys it in other
+		void relocate(slot_type& other)
 		{
-			new(&content) key_value_pair(key, std::forward<Args>(args)...);
-			state = full;
+			auto& source = other.pair();
+			new(&content) key_value_pair(std::move(source.key), std::move(source.value));
+			static_cast<hash_field&>(*this) = other;
+			other.release();
 		}
 
-		void release()
+		void release() noexcept(std::is_nothrow_destructible_v<key_type> && std::is_nothrow_destructible_v<value_type>)
 		{
 			pair().~key_value_pair();
-			state = deleted;
 		}
 
-		slot_type& operator=(slot_type&& other) noexcept = default;
-		slot_type& operator=(const slot_type& other) = default;
-
 		key_value_pair& pair() noexcept { return reinterpret_cast<key_value_pair&>(content); };
 		const key_value_pair& pair() const noexcept { return reinterpret_cast<const key_value_pair&>(content); };
 	};
 
-	using storage_type = std::vector<slot_type>;
+	// slots, control bytes and scratch space all come from (rebound copies of) the map's allocator
+	template<typename T>
+	using rebind_alloc = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+
+	using storage_type = hash_map_detail::table_array<slot_type, rebind_alloc<slot_type>>;
+
+	using ctrl_type = hash_map_detail::ctrl_type;
+	using group_type = hash_map_detail::group;
+	using control_type = hash_map_detail::table_array<ctrl_type, rebind_alloc<ctrl_type>>;
+
+	static constexpr bool robin_hood = std::is_same_v<Probing, hash_map_probing::robin_hood>;
 
 public:
 	using size_type = typename storage_type::size_type;
@@ -77,34 +625,83 @@ public:
 	{
 	public:
 		friend class hash_map;
-		friend class const_iterator;
 
 		using iterator_category = std::forward_iterator_tag;
 		using value_type = key_value_pair;
 		using reference = const key_value_pair&;
 		using pointer = const key_value_pair*;
-		using differnce_type = std::ptrdiff_t;
+		using difference_type = std::ptrdiff_t;
 
 	private:
-		typename hash_map::storage_type::const_iterator slot;
+		const ctrl_type* ctrl = nullptr;
+		const ctrl_type* last = nullptr;
+		const slot_type* slot = nullptr;
+
+		// table to continue with once this one is exhausted (the new table while growing incrementally)
+		const ctrl_type* next_ctrl = nullptr;
+		const ctrl_type* next_last = nullptr;
+		const slot_type* next_slot = nullptr;
+
+		const_iterator(const ctrl_type* first, const ctrl_type* end, const slot_type* payload) noexcept
+			: ctrl(first),
+			  last(end),
+			  slot(payload) {}
+
+		const_iterator(const ctrl_type* first, const ctrl_type* end, const slot_type* payload, const ctrl_type* next_first, const ctrl_type* next_end, const slot_type* next_payload) noexcept
+			: ctrl(first),
+			  last(end),
+			  slot(payload),
+			  next_ctrl(next_first),
+			  next_last(next_end),
+			  next_slot(next_payload) {}
+
+		const_iterator& skip_free() noexcept
+		{
+			while(true)
+			{
+				while(ctrl != last && !hash_map_detail::is_full(*ctrl))
+				{
+					++ctrl;
+					++slot;
+				}
+
+				if(ctrl != last || next_ctrl == nullptr) return *this;
+
+				ctrl = std::exchange(next_ctrl, nullptr);
+				last = next_last;
+				slot = next_slot;
+			}
+		}
 
 	public:
 		const_iterator() = default;
 
-		const_iterator(typename hash_map::storage_type::const_iterator first) noexcept
-			: slot(first) {}
-
 		const_iterator(iterator other) noexcept
-			: slot(other.slot) {}
-
+			: ctrl(other.ctrl),
+			  last(other.last),
+			  slot(other.slot),
+			  next_ctrl(other.next_ctrl),
+			  next_last(other.next_last),
+			  next_slot(other.next_slot) {}
+
+		const_iterator& operator++() noexcept
+		{
+			++ctrl;
+			++slot;
+			return skip_free();
+		}
 
-		const_iterator& operator++() noexcept { return *this; }
-		const_iterator operator++(int) noexcept { return *this; }
+		const_iterator operator++(int) noexcept
+		{
+			auto copy = *this;
+			++*this;
+			return copy;
+		}
 
 		reference operator*() const noexcept { return slot->pair(); }
 		pointer operator->() const noexcept { return &slot->pair(); }
 
-		bool operator==(const_iterator other) const noexcept { return slot == other.slot; }
+		bool operator==(const_iterator other) const noexcept { return ctrl == other.ctrl; }
 		bool operator!=(const_iterator other) const noexcept { return !(*this == other); }
 	};
 
@@ -121,182 +718,1862 @@ public:
 		using difference_type = std::ptrdiff_t;
 
 	private:
-		typename hash_map::storage_type::iterator slot;
-		typename hash_map::storage_type::iterator end;
+		const ctrl_type* ctrl = nullptr;
+		const ctrl_type* last = nullptr;
+		slot_type* slot = nullptr;
+
+		// table to continue with once this one is exhausted (the new table while growing incrementally)
+		const ctrl_type* next_ctrl = nullptr;
+		const ctrl_type* next_last = nullptr;
+		slot_type* next_slot = nullptr;
+
+		iterator(const ctrl_type* first, const ctrl_type* end, slot_type* payload) noexcept
+			: ctrl(first),
+			  last(end),
+			  slot(payload) {}
+
+		iterator(const ctrl_type* first, const ctrl_type* end, slot_type* payload, const ctrl_type* next_first, const ctrl_type* next_end, slot_type* next_payload) noexcept
+			: ctrl(first),
+			  last(end),
+			  slot(payload),
+			  next_ctrl(next_first),
+			  next_last(next_end),
+			  next_slot(next_payload) {}
+
+		iterator& skip_free() noexcept
+		{
+			while(true)
+			{
+				while(ctrl != last && !hash_map_detail::is_full(*ctrl))
+				{
+					++ctrl;
+					++slot;
+				}
+
+				if(ctrl != last || next_ctrl == nullptr) return *this;
+
+				ctrl = std::exchange(next_ctrl, nullptr);
+				last = next_last;
+				slot = next_slot;
+			}
+		}
 
 	public:
 		iterator() = default;
 
-		iterator(typename hash_map::storage_type::iterator first, typename hash_map::storage_type::iterator last)
-			: slot(first),
-			  end(last) {}
-
 		iterator& operator++() noexcept
 		{
-			do
-			{
-				++slot;
-			}
-			while(slot != end && slot->state != slot_type::full);
-
-			return *this;
+			++ctrl;
+			++slot;
+			return skip_free();
 		}
 
 		iterator operator++(int) noexcept
 		{
-			return *this;
+			auto copy = *this;
+			++*this;
+			return copy;
 		}
 
 		reference operator*() const noexcept { return slot->pair(); }
 		pointer operator->() const noexcept { return &slot->pair(); }
 
-		bool operator==(iterator other) const noexcept { return slot == other.slot; }
+		bool operator==(iterator other) const noexcept { return ctrl == other.ctrl; }
 		bool operator!=(iterator other) const noexcept { return !(*this == other); }
 	};
 
-private:
+	// consecutive slots of one table, see slot_ranges(); its iterators stop at the end of the range
+	template<typename Iterator>
+	class slot_range
+	{
+	public:
+		friend class hash_map;
 
-	storage_type storage;
-	size_type count = 0;
-	Hash hash{};
+		Iterator begin() const noexcept { return first; }
+		Iterator end() const noexcept { return last; }
 
-public:
-	hash_map() noexcept
-		: storage(10) { }
+	private:
+		Iterator first;
+		Iterator last;
+	};
 
-	// mutators
+	using range = slot_range<iterator>;
+	using const_range = slot_range<const_iterator>;
 
-	iterator insert(key_type key, const value_type& value) { return emplace(key, value); }
-	iterator insert(key_type key, value_type&& value) { return emplace(key, std::move(value)); }
+private:
+	static constexpr size_type npos = size_type(-1);
 
-	template<typename... Args>
-	iterator emplace(key_type key, Args&&... args)
-	{
-		if(auto match = find(key); match != end())
-		{
-			match.slot->set(key, std::forward<Args>(args)...);
+	// only participates in overload resolution if both the hasher and the key comparison are
+	// transparent, K is then any type both of them accept
+	template<typename K, typename Result>
+	using if_transparent = std::enable_if_t<
+		hash_map_detail::is_transparent<Hash>::value &&
+		hash_map_detail::is_transparent<KeyEqual>::value &&
+		!std::is_convertible_v<K, const_iterator> &&
+		!std::is_convertible_v<K, iterator>, Result>;
 
-			return match;
-		}
+	// an insert that would exceed the max load factor because of tombstones purges them instead of
+	// growing the table if at least 1 / purge_divisor of all slots are tombstones
+	static constexpr size_type purge_divisor = 8;
 
-		if((size() + 1.0) / capacity() > max_load_factor())
-		{
-			rehash(capacity() * 2);
-		}
+	// number of keys insert_batch() and the batched lookups hash and prefetch ahead of probing them
+	static constexpr size_type batch_size = 16;
 
-		auto slot = std::next(storage.begin(), hash(key) % capacity());
-		slot = probe(slot, slot_type::deleted | slot_type::empty, slot_type::full);
+	// rehashing or building with several threads only pays off with this many elements per thread
+	static constexpr size_type parallel_grain = 16384;
 
-		slot->set(key, std::forward<Args>(args)...);
-		++count;
+	// copying the hasher, key comparison and policy is all a move has to do besides taking over the table
+	static constexpr bool nothrow_copyable_functors = std::is_nothrow_copy_constructible_v<Hash> && std::is_nothrow_copy_constructible_v<KeyEqual> && std::is_nothrow_copy_constructible_v<GrowthPolicy>;
+	static constexpr bool nothrow_assignable_functors = std::is_nothrow_copy_assignable_v<Hash> && std::is_nothrow_copy_assignable_v<KeyEqual> && std::is_nothrow_copy_assignable_v<GrowthPolicy>;
 
-		return iterator{ slot, storage.end() };
-	}
+	// move assignment can always take over the table of the other map, without comparing allocators
+	static constexpr bool move_assignment_takes_over = std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value || std::allocator_traits<Allocator>::is_always_equal::value;
 
-	void erase(const_iterator iter)
+	// tables of elements that can be moved as plain bytes grow without a second table if the allocator
+	// can resize blocks in place; robin hood probing has to order elements by displacement instead
+	static constexpr bool grows_in_place = !robin_hood && std::is_trivially_copyable_v<key_type> && std::is_trivially_copyable_v<value_type> && hash_map_detail::can_reallocate<rebind_alloc<slot_type>>::value;
+
+	// elements can be placed from several threads at once if moving them cannot throw (a failed move
+	// could not be undone) and their slots do not depend on each other, as they do with robin hood
+	static constexpr bool parallel_rehash = !robin_hood && std::is_nothrow_move_constructible_v<key_type> && std::is_nothrow_move_constructible_v<value_type>;
+
+	// the previous table while growing incrementally; its slots are moved over a few at a time,
+	// starting at index next, and lookups have to consult it until it is empty
+	struct migration_type
 	{
-		if(iter == end()) throw std::out_of_range{ "cannot delete out-of-range iterator" };
+		storage_type storage;
+		control_type control;
+		size_type next = 0;
+	};
 
-		const_cast<slot_type&>(*iter.slot).release();
-		--count;
-	}
+	storage_type storage;
+	control_type control;
+	migration_type migration;
+	size_type count = 0;
+	size_type tombstones = 0;
+	size_type growth_limit = 0;
+	Hash hash{};
+	KeyEqual equal{};
+	GrowthPolicy policy{};
+
+public:
+	hash_map()
+		: hash_map(GrowthPolicy{}) { }
+
+	explicit hash_map(const GrowthPolicy& growth)
+		: hash_map(0, growth) { }
 
-	void erase(key_type key)
+	explicit hash_map(const Allocator& alloc)
+		: hash_map(0, GrowthPolicy{}, alloc) { }
+
+	// sizes the table once so that expected elements fit without growing
+	explicit hash_map(size_type expected, const GrowthPolicy& growth = GrowthPolicy{}, const Allocator& alloc = Allocator{})
+		: storage(alloc),
+		  control(alloc),
+		  migration{ storage_type(alloc), control_type(alloc) },
+		  policy(growth)
 	{
-		erase(find(key));
+		policy.validate();
+
+		storage = storage_type(capacity_for(expected), storage.get_allocator());
+		control = control_type(capacity(), hash_map_detail::ctrl_empty, control.get_allocator());
+		growth_limit = limit_for(capacity());
 	}
 
-	iterator find(key_type key) noexcept
+	// the table is presized from the length of the range if it can be determined without consuming it
+	template<typename InputIt, typename = std::enable_if_t<hash_map_detail::is_iterator<InputIt>::value>>
+	hash_map(InputIt first, InputIt last, const GrowthPolicy& growth = GrowthPolicy{}, const Allocator& alloc = Allocator{})
+		: hash_map(range_size(first, last), growth, alloc)
 	{
-		if(empty()) return end();
+		insert(first, last);
+	}
 
-		auto iter = std::next(storage.begin(), hash(key) % capacity()); // storage.begin();
+	hash_map(std::initializer_list<key_value_pair> elements, const GrowthPolicy& growth = GrowthPolicy{}, const Allocator& alloc = Allocator{})
+		: hash_map(elements.begin(), elements.end(), growth, alloc) { }
 
-		iter = probe(iter, slot_type::full, slot_type::deleted);
-		if(iter->state == slot_type::empty) return end();
+	hash_map(const hash_map& other)
+		: hash_map(other, std::allocator_traits<Allocator>::select_on_container_copy_construction(other.get_allocator())) { }
 
-		while(iter->pair().key != key)
+	hash_map(const hash_map& other, const Allocator& alloc)
+		: storage(other.capacity(), alloc),
+		  control(other.capacity(), hash_map_detail::ctrl_empty, alloc),
+		  migration{ storage_type(alloc), control_type(alloc) },
+		  growth_limit(other.growth_limit),
+		  hash(other.hash),
+		  equal(other.equal),
+		  policy(other.policy)
+	{
+		// slots have no destructor of their own, the elements copied so far are destroyed by hand if a
+		// copy throws
+		try
 		{
-			iter = probe(std::next(iter), slot_type::full, slot_type::deleted);
-			if(iter->state == slot_type::empty) return end();
+			copy_elements(other);
+		}
+		catch(...)
+		{
+			release_all();
+			throw;
 		}
-
-		return iterator{ iter, storage.end() };
 	}
 
-	const_iterator find(key_type) const noexcept { return {}; }
+	// takes over the table of other, which is left empty without any table (capacity 0) until its
+	// next insert
+	hash_map(hash_map&& other) noexcept(nothrow_copyable_functors)
+		: storage(std::exchange(other.storage, storage_type(other.storage.get_allocator()))),
+		  control(std::exchange(other.control, control_type(other.control.get_allocator()))),
+		  migration(std::exchange(other.migration, migration_type{ storage_type(other.storage.get_allocator()), control_type(other.control.get_allocator()) })),
+		  count(std::exchange(other.count, 0)),
+		  tombstones(std::exchange(other.tombstones, 0)),
+		  growth_limit(std::exchange(other.growth_limit, 0)),
+		  hash(other.hash),
+		  equal(other.equal),
+		  policy(other.policy) { }
+
+	// elements are moved one by one if alloc cannot free memory of the other map's allocator
+	hash_map(hash_map&& other, const Allocator& alloc)
+		: storage(alloc),
+		  control(alloc),
+		  migration{ storage_type(alloc), control_type(alloc) },
+		  hash(other.hash),
+		  equal(other.equal),
+		  policy(other.policy)
+	{
+		if(get_allocator() == other.get_allocator())
+		{
+			swap(other);
+			return;
+		}
+
+		other.finish_migration();
+		reserve(other.size());
+
+		for(size_type index = 0; index < other.capacity(); ++index)
+		{
+			if(hash_map_detail::is_full(other.control[index]))
+			{
+				auto& slot = other.storage[index];
+				const auto target = prepare_insert(other.slot_hash(slot));
+
+				storage[target].relocate(slot);
+				control[target] = other.control[index];
+				other.control[index] = hash_map_detail::ctrl_empty;
+				++count;
+				--other.count;
+			}
+		}
+
+		std::fill(other.control.begin(), other.control.end(), hash_map_detail::ctrl_empty);
+		other.tombstones = 0;
+	}
+
+	~hash_map() noexcept(std::is_nothrow_destructible_v<key_type> && std::is_nothrow_destructible_v<value_type>)
+	{
+		release_all();
+	}
+
+	// assignment keeps the allocator of this map, the swap therefore never mixes allocators
+	hash_map& operator=(const hash_map& other)
+	{
+		if(this != &other)
+		{
+			hash_map copy{ other, get_allocator() };
+			swap(copy);
+		}
+
+		return *this;
+	}
+
+	// takes over the table of other like the move constructor if the allocators allow it; only maps with
+	// unequal allocators that do not propagate move their elements one by one into a new table
+	hash_map& operator=(hash_map&& other) noexcept(move_assignment_takes_over && nothrow_assignable_functors)
+	{
+		if(this == &other) return *this;
+
+		if(move_assignment_takes_over || get_allocator() == other.get_allocator())
+		{
+			hash = other.hash;
+			equal = other.equal;
+			policy = other.policy;
+
+			release_all();
+
+			storage = std::exchange(other.storage, storage_type(other.storage.get_allocator()));
+			control = std::exchange(other.control, control_type(other.control.get_allocator()));
+			migration = std::exchange(other.migration, migration_type{ storage_type(other.storage.get_allocator()), control_type(other.control.get_allocator()) });
+			count = std::exchange(other.count, 0);
+			tombstones = std::exchange(other.tombstones, 0);
+			growth_limit = std::exchange(other.growth_limit, 0);
+		}
+		else
+		{
+			hash_map moved{ std::move(other), get_allocator() };
+			swap(moved);
+		}
+
+		return *this;
+	}
+
+	// like for the standard containers, the allocators of both maps have to compare equal
+	void swap(hash_map& other) noexcept
+	{
+		using std::swap;
+
+		swap(storage, other.storage);
+		swap(control, other.control);
+		swap(migration, other.migration);
+		swap(count, other.count);
+		swap(tombstones, other.tombstones);
+		swap(growth_limit, other.growth_limit);
+		swap(hash, other.hash);
+		swap(equal, other.equal);
+		swap(policy, other.policy);
+	}
+
+	// mutators
+
+	iterator insert(const key_type& key, const value_type& value) { return emplace_impl(key, value); }
+	iterator insert(const key_type& key, value_type&& value) { return emplace_impl(key, std::move(value)); }
+	iterator insert(key_type&& key, const value_type& value) { return emplace_impl(std::move(key), value); }
+	iterator insert(key_type&& key, value_type&& value) { return emplace_impl(std::move(key), std::move(value)); }
+
+	// later elements of the range overwrite earlier ones with the same key, like insert() does
+	template<typename InputIt, typename = std::enable_if_t<hash_map_detail::is_iterator<InputIt>::value>>
+	void insert(InputIt first, InputIt last)
+	{
+		if constexpr(hash_map_detail::is_forward_iterator<InputIt>)
+		{
+			insert_batch(first, last);
+		}
+		else
+		{
+			for(; first != last; ++first)
+			{
+				insert_element(*first, hash_of(element_key(*first)));
+			}
+		}
+	}
+
+	// inserts a range in blocks of batch_size elements: all keys of a block are hashed and their
+	// home groups prefetched before the first of them is probed, which overlaps the cache misses
+	template<typename ForwardIt>
+	void insert_batch(ForwardIt first, ForwardIt last)
+	{
+		static_assert(hash_map_detail::is_forward_iterator<ForwardIt>, "insert_batch() passes over each block twice");
+
+		// only an empty map can assume that every key of the range is new; presizing anything else would
+		// grow the table for batches that just update existing keys. Growing in the middle of a block
+		// is harmless, insert_element() probes the current table with the stored hashes, only the
+		// prefetches of the rest of the block are wasted.
+		if(empty()) reserve(range_size(first, last));
+
+		std::size_t hashes[batch_size];
+
+		while(first != last)
+		{
+			size_type block = 0;
+
+			for(auto iter = first; iter != last && block < batch_size; ++iter, ++block)
+			{
+				hashes[block] = hash_of(element_key(*iter));
+				prefetch_home_group(hashes[block]);
+			}
+
+			for(size_type index = 0; index < block; ++index, ++first)
+			{
+				insert_element(*first, hashes[index]);
+			}
+		}
+	}
+
+	void insert(std::initializer_list<key_value_pair> elements) { insert(elements.begin(), elements.end()); }
+
+	// inserts a range of key/value pairs on up to threads threads. The keys are hashed in parallel and
+	// sorted by the part of the table their home group lies in, then every thread fills one part of
+	// the table; the few elements whose probe sequence leaves their part are inserted afterwards. An
+	// element whose key is already present is merged into the existing one with
+	// on_duplicate(existing value, new value), in input order (see hash_map_duplicates). Every thread
+	// calls its own copy of on_duplicate, so calls for different keys run concurrently on different
+	// copies; whatever the copies share, e.g. through references, has to be safe to use from several
+	// threads. If an element cannot be constructed, the exception is rethrown once all threads have
+	// finished, with some elements of the range inserted and others not.
+	template<typename RandomIt, typename OnDuplicate = hash_map_duplicates::keep_last>
+	void build_parallel(RandomIt first, RandomIt last, size_type threads, OnDuplicate on_duplicate = {})
+	{
+		static_assert(std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<RandomIt>::iterator_category>, "build_parallel() splits the range between threads");
+
+		const auto n = size_type(last - first);
+
+		// parts of the table are filled without tombstones, migration or growth getting in the way
+		if(rehashing() || tombstones > 0 || capacity_for(size() + n) > capacity())
+		{
+			rehash_to(std::max(capacity(), capacity_for(size() + n)));
+		}
+
+		const auto parts = std::min({ threads, group_count(), n / parallel_grain });
+
+		if(robin_hood || parts < 2)
+		{
+			for(; first != last; ++first)
+			{
+				insert_merging(*first, hash_of(element_key(*first)), on_duplicate);
+			}
+
+			return;
+		}
+
+		// input chunk c puts the indices of its elements that belong in part p into sorted[c * parts + p]
+		std::vector<std::size_t> hashes(n);
+		std::vector<std::vector<size_type>> sorted(parts * parts);
+		std::vector<std::vector<size_type>> deferred(parts);
+		std::vector<size_type> inserted(parts);
+		std::vector<std::exception_ptr> errors(parts);
+
+		hash_map_detail::thread_per_task{}(parts, [&](size_type chunk) {
+			try
+			{
+				for(auto index = n * chunk / parts; index < n * (chunk + 1) / parts; ++index)
+				{
+					hashes[index] = hash_of(element_key(first[index]));
+					sorted[chunk * parts + part_of(hashes[index], parts)].push_back(index);
+				}
+			}
+			catch(...)
+			{
+				errors[chunk] = std::current_exception();
+			}
+		});
+
+		rethrow_first(errors);
+
+		hash_map_detail::thread_per_task{}(parts, [&](size_type part) {
+			try
+			{
+				const auto last_group = part_end(part, parts);
+				auto merge = on_duplicate;
+
+				for(size_type chunk = 0; chunk < parts; ++chunk)
+				{
+					for(const auto index : sorted[chunk * parts + part])
+					{
+						const auto& element = first[index];
+						const auto target = probe_part(element_key(element), hashes[index], last_group);
+
+						if(target.index == npos)
+						{
+							deferred[part].push_back(index);
+						}
+						else if(target.found)
+						{
+							merge(storage[target.index].pair().value, element_value(element));
+						}
+						else
+						{
+							storage[target.index].set(element_key(element), element_value(element));
+							storage[target.index].store(target.hash);
+							control[target.index] = hash_map_detail::tag_of(target.hash);
+							++inserted[part];
+						}
+					}
+				}
+			}
+			catch(...)
+			{
+				errors[part] = std::current_exception();
+			}
+		});
+
+		for(const auto added : inserted)
+		{
+			count += added;
+		}
+
+		rethrow_first(errors);
+
+		// all elements of a key are deferred if its first one was, so their order is kept
+		for(const auto& indices : deferred)
+		{
+			for(const auto index : indices)
+			{
+				insert_merging(first[index], hashes[index], on_duplicate);
+			}
+		}
+	}
+
+	// makes room for n elements in total, so that inserting them does not grow the table again
+	void reserve(size_type n)
+	{
+		if(capacity_for(n) > capacity()) rehash_to(capacity_for(n));
+	}
+
+	// rebuilds the table with at least n slots, but never fewer than the current size needs; this
+	// also clears all tombstones and finishes incremental growth
+	void rehash(size_type n) { rehash_to(std::max(round_capacity(n), capacity_for(size()))); }
+
+	// reserve() and rehash() that split the old table into tasks ranges whose elements are placed into
+	// the new table concurrently, e.g. on a thread pool of the caller. parallel_for(tasks, task) has to
+	// call task(0) ... task(tasks - 1) exactly once each, on any threads, and return once all calls have
+	// returned; it must not throw. Tables that cannot be rehashed in parallel (see parallel_rehash)
+	// are rehashed on the calling thread.
+	template<typename ParallelFor>
+	void reserve(size_type n, size_type tasks, ParallelFor&& parallel_for)
+	{
+		if(capacity_for(n) > capacity()) rehash_to(capacity_for(n), tasks, parallel_for);
+	}
+
+	template<typename ParallelFor>
+	void rehash(size_type n, size_type tasks, ParallelFor&& parallel_for)
+	{
+		rehash_to(std::max(round_capacity(n), capacity_for(size())), tasks, parallel_for);
+	}
+
+	template<typename... Args>
+	iterator emplace(const key_type& key, Args&&... args) { return emplace_impl(key, std::forward<Args>(args)...); }
+
+	template<typename... Args>
+	iterator emplace(key_type&& key, Args&&... args) { return emplace_impl(std::move(key), std::forward<Args>(args)...); }
+
+	void erase(const_iterator iter)
+	{
+		if(iter == end()) throw std::out_of_range{ "cannot delete out-of-range iterator" };
+
+		if(in_migration(iter.ctrl))
+		{
+			// nothing gets inserted into the previous table anymore, so a tombstone is all it needs
+			const auto index = size_type(iter.ctrl - migration.control.data());
+
+			migration.storage[index].release();
+			migration.control[index] = hash_map_detail::ctrl_deleted;
+			--count;
+
+			return;
+		}
+
+		const auto index = size_type(iter.ctrl - control.data());
+
+		storage[index].release();
+		--count;
+
+		if constexpr(robin_hood)
+		{
+			shift_back(index);
+		}
+		else
+		{
+			// a group that still has an empty slot never made a probe sequence continue past it,
+			// so the erased slot can become empty again instead of leaving a tombstone behind
+			const group_type group{ &control[index - index % group_type::width] };
+
+			if(group.match_empty())
+			{
+				control[index] = hash_map_detail::ctrl_empty;
+			}
+			else
+			{
+				control[index] = hash_map_detail::ctrl_deleted;
+				++tombstones;
+			}
+		}
+
+		if(load_factor() < policy.shrink_load_factor && capacity_for(size()) < capacity())
+		{
+			rehash_to(capacity_for(size()));
+		}
+	}
+
+	void erase(const key_type& key)
+	{
+		erase(find(key));
+	}
+
+	template<typename K>
+	if_transparent<K, void> erase(const K& key)
+	{
+		erase(find(key));
+	}
+
+	// inserts a value constructed from args unless key is already present; a key_type is only built
+	// from key if the insertion happens
+	template<typename... Args>
+	std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args)
+	{
+		return try_emplace_impl(hash_of(key), key, std::forward<Args>(args)...);
+	}
+
+	template<typename... Args>
+	std::pair<iterator, bool> try_emplace(key_type&& key, Args&&... args)
+	{
+		return try_emplace_impl(hash_of(key), std::move(key), std::forward<Args>(args)...);
+	}
+
+	template<typename K, typename... Args>
+	if_transparent<K, std::pair<iterator, bool>> try_emplace(K&& key, Args&&... args)
+	{
+		return try_emplace_impl(hash_of(key), std::forward<K>(key), std::forward<Args>(args)...);
+	}
+
+	// assigns value to the element with key, or inserts it if key is not present yet
+	template<typename M>
+	std::pair<iterator, bool> insert_or_assign(const key_type& key, M&& value)
+	{
+		return insert_or_assign_impl(hash_of(key), key, std::forward<M>(value));
+	}
+
+	template<typename M>
+	std::pair<iterator, bool> insert_or_assign(key_type&& key, M&& value)
+	{
+		return insert_or_assign_impl(hash_of(key), std::move(key), std::forward<M>(value));
+	}
+
+	template<typename K, typename M>
+	if_transparent<K, std::pair<iterator, bool>> insert_or_assign(K&& key, M&& value)
+	{
+		return insert_or_assign_impl(hash_of(key), std::forward<K>(key), std::forward<M>(value));
+	}
+
+	// try_emplace() and insert_or_assign() for a key that was hashed beforehand, e.g. by a container
+	// that picks one of several maps by the hash; key_hash has to be what this map's hasher gives
+	// for key, i.e. hash_map_detail::hash_key(hasher, key)
+	template<typename... Args>
+	std::pair<iterator, bool> try_emplace_hashed(std::size_t key_hash, const key_type& key, Args&&... args)
+	{
+		return try_emplace_impl(key_hash, key, std::forward<Args>(args)...);
+	}
+
+	template<typename... Args>
+	std::pair<iterator, bool> try_emplace_hashed(std::size_t key_hash, key_type&& key, Args&&... args)
+	{
+		return try_emplace_impl(key_hash, std::move(key), std::forward<Args>(args)...);
+	}
+
+	template<typename K, typename... Args>
+	if_transparent<K, std::pair<iterator, bool>> try_emplace_hashed(std::size_t key_hash, K&& key, Args&&... args)
+	{
+		return try_emplace_impl(key_hash, std::forward<K>(key), std::forward<Args>(args)...);
+	}
+
+	template<typename M>
+	std::pair<iterator, bool> insert_or_assign_hashed(std::size_t key_hash, const key_type& key, M&& value)
+	{
+		return insert_or_assign_impl(key_hash, key, std::forward<M>(value));
+	}
+
+	template<typename M>
+	std::pair<iterator, bool> insert_or_assign_hashed(std::size_t key_hash, key_type&& key, M&& value)
+	{
+		return insert_or_assign_impl(key_hash, std::move(key), std::forward<M>(value));
+	}
+
+	template<typename K, typename M>
+	if_transparent<K, std::pair<iterator, bool>> insert_or_assign_hashed(std::size_t key_hash, K&& key, M&& value)
+	{
+		return insert_or_assign_impl(key_hash, std::forward<K>(key), std::forward<M>(value));
+	}
+
+	// Clears all tombstones without reallocating: every element is placed again at the first free
+	// slot of its probe sequence, which is never further away than its current one.
+	void purge()
+	{
+		if(tombstones == 0) return;
+
+		place_again();
+	}
+
+	// while growing incrementally, the non-const lookups also migrate some elements (which
+	// invalidates iterators)
+	iterator find(const key_type& key)
+	{
+		migrate_step();
+		return iterator_at(locate(key));
+	}
+
+	const_iterator find(const key_type& key) const noexcept { return iterator_at(locate(key)); }
+
+	template<typename K>
+	if_transparent<K, iterator> find(const K& key)
+	{
+		migrate_step();
+		return iterator_at(locate(key));
+	}
+
+	template<typename K>
+	if_transparent<K, const_iterator> find(const K& key) const noexcept { return iterator_at(locate(key)); }
+
+	bool contains(const key_type& key) const noexcept { return locate(key).index != npos; }
+
+	template<typename K>
+	if_transparent<K, bool> contains(const K& key) const noexcept { return locate(key).index != npos; }
+
+	// lookups of a key that was hashed beforehand, see try_emplace_hashed()
+	iterator find(const key_type& key, std::size_t key_hash)
+	{
+		migrate_step();
+		return iterator_at(locate(key, key_hash));
+	}
+
+	const_iterator find(const key_type& key, std::size_t key_hash) const noexcept { return iterator_at(locate(key, key_hash)); }
+
+	template<typename K>
+	if_transparent<K, iterator> find(const K& key, std::size_t key_hash)
+	{
+		migrate_step();
+		return iterator_at(locate(key, key_hash));
+	}
+
+	template<typename K>
+	if_transparent<K, const_iterator> find(const K& key, std::size_t key_hash) const noexcept { return iterator_at(locate(key, key_hash)); }
+
+	bool contains(const key_type& key, std::size_t key_hash) const noexcept { return locate(key, key_hash).index != npos; }
+
+	template<typename K>
+	if_transparent<K, bool> contains(const K& key, std::size_t key_hash) const noexcept { return locate(key, key_hash).index != npos; }
+
+	// batched lookups write one result per key of the range to out, in order: find_many() writes
+	// iterators (end() for missing keys) and contains_many() writes bools. Keys are resolved in
+	// blocks of batch_size whose home groups are all prefetched first, so the cache misses of a
+	// block overlap instead of being paid one after the other. Unlike find(), the non-const
+	// version does not advance incremental growth.
+	template<typename ForwardIt, typename OutputIt>
+	OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out)
+	{
+		locate_many(first, last, [&](location where) { *out++ = iterator_at(where); });
+		return out;
+	}
+
+	template<typename ForwardIt, typename OutputIt>
+	OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const
+	{
+		locate_many(first, last, [&](location where) { *out++ = iterator_at(where); });
+		return out;
+	}
+
+	template<typename ForwardIt, typename OutputIt>
+	OutputIt contains_many(ForwardIt first, ForwardIt last, OutputIt out) const
+	{
+		locate_many(first, last, [&](location where) { *out++ = where.index != npos; });
+		return out;
+	}
+
+	// queries
+
+	allocator_type get_allocator() const noexcept { return allocator_type(storage.get_allocator()); }
+
+	bool empty() const noexcept { return count == 0; }
+	size_type size() const noexcept { return count; }
+	size_type tombstone_count() const noexcept { return tombstones; }
+	size_type capacity() const noexcept { return storage.size(); }
+
+	// most elements the map can hold at its max load factor; reserve() and inserts beyond it throw
+	// std::length_error
+	size_type max_size() const noexcept { return limit_for(max_capacity()); }
+
+	// whether elements of a previous table are still waiting to be migrated by incremental growth
+	bool rehashing() const noexcept { return !migration.control.empty(); }
+
+	double load_factor() const noexcept { return capacity() == 0 ? 0.0 : double(size()) / capacity(); }
+	double max_load_factor() const noexcept { return policy.max_load_factor; }
+
+	void max_load_factor(double value)
+	{
+		auto growth = policy;
+		growth.max_load_factor = value;
+		growth_policy(growth);
+	}
+
+	const GrowthPolicy& growth_policy() const noexcept { return policy; }
+
+	// walks the whole table, so it costs about as much as iterating over it
+	hash_map_stats stats() const
+	{
+		hash_map_stats result{};
+
+		result.size = size();
+		result.capacity = capacity();
+		result.tombstones = tombstones;
+		result.load_factor = load_factor();
+		result.effective_load_factor = capacity() == 0 ? 0.0 : double(size() + tombstones) / capacity();
+
+		if(rehashing()) collect_stats(result, migration.storage, migration.control);
+		collect_stats(result, storage, control);
+
+		size_type distances = 0;
+
+		for(size_type distance = 0; distance < result.probe_histogram.size(); ++distance)
+		{
+			distances += distance * result.probe_histogram[distance];
+		}
+
+		if(size() > 0)
+		{
+			result.mean_probe_distance = double(distances) / size();
+			result.bytes_per_element = double(result.allocated_bytes) / size();
+		}
+
+		return result;
+	}
+
+	// applies a new policy right away, which rehashes if the current size does not fit it; a pending
+	// incremental migration is finished first, since the new policy may not migrate at all
+	void growth_policy(const GrowthPolicy& growth)
+	{
+		growth.validate();
+		finish_migration();
+		policy = growth;
+
+		if(size() + tombstones > limit_for(capacity()))
+		{
+			rehash_to(capacity_for(size()));
+		}
+		else
+		{
+			growth_limit = limit_for(capacity());
+		}
+	}
+
+	// iterator
+
+	// while growing incrementally, iteration visits the remaining elements of the previous table first
+	iterator begin() noexcept { return (rehashing() ? make_migration_iterator(0) : make_iterator(0)).skip_free(); }
+	const_iterator begin() const noexcept { return (rehashing() ? make_migration_iterator(0) : make_iterator(0)).skip_free(); }
+	const_iterator cbegin() const noexcept { return begin(); }
+
+	iterator end() noexcept { return make_iterator(capacity()); }
+	const_iterator end() const noexcept { return make_iterator(capacity()); }
+	const_iterator cend() const noexcept { return end(); }
+
+	// splits the slots into parts disjoint ranges of equal size (twice as many while growing
+	// incrementally, the previous table is split too) that together hold every element once; the
+	// ranges can be iterated on different threads, e.g. by std::for_each(std::execution::par, ...)
+	std::vector<range> slot_ranges(size_type parts)
+	{
+		std::vector<range> ranges{};
+
+		if(rehashing()) split_slots(ranges, migration.control.data(), migration.storage.data(), migration.control.size(), parts);
+		split_slots(ranges, control.data(), storage.data(), capacity(), parts);
+
+		return ranges;
+	}
+
+	std::vector<const_range> slot_ranges(size_type parts) const
+	{
+		std::vector<const_range> ranges{};
+
+		if(rehashing()) split_slots(ranges, migration.control.data(), migration.storage.data(), migration.control.size(), parts);
+		split_slots(ranges, control.data(), storage.data(), capacity(), parts);
+
+		return ranges;
+	}
+
+	// calls fn with every element; parallel_for (see rehash()) runs one task per range of
+	// slot_ranges(tasks). fn is called concurrently and must not insert or erase elements; the first
+	// exception it throws is rethrown once all tasks have finished.
+	template<typename ParallelFor, typename F>
+	void for_each(size_type tasks, ParallelFor&& parallel_for, F&& fn)
+	{
+		for_each_range(slot_ranges(tasks), parallel_for, fn);
+	}
+
+	template<typename ParallelFor, typename F>
+	void for_each(size_type tasks, ParallelFor&& parallel_for, F&& fn) const
+	{
+		for_each_range(slot_ranges(tasks), parallel_for, fn);
+	}
+
+	// for_each() on threads threads of its own
+	template<typename F>
+	void for_each_parallel(size_type threads, F&& fn) { for_each(threads, hash_map_detail::thread_per_task{}, fn); }
+
+	template<typename F>
+	void for_each_parallel(size_type threads, F&& fn) const { for_each(threads, hash_map_detail::thread_per_task{}, fn); }
+
+private:
+	template<typename InputIt>
+	static size_type range_size(InputIt first, InputIt last)
+	{
+		if constexpr(hash_map_detail::is_forward_iterator<InputIt>)
+		{
+			return size_type(std::distance(first, last));
+		}
+		else
+		{
+			return 0;
+		}
+	}
+
+	template<typename Element>
+	static const auto& element_key(const Element& element) noexcept
+	{
+		if constexpr(hash_map_detail::is_std_pair_like<Element>::value)
+		{
+			return element.first;
+		}
+		else
+		{
+			return element.key;
+		}
+	}
+
+	template<typename Element>
+	static const auto& element_value(const Element& element) noexcept
+	{
+		if constexpr(hash_map_detail::is_std_pair_like<Element>::value)
+		{
+			return element.second;
+		}
+		else
+		{
+			return element.value;
+		}
+	}
+
+	template<typename Element>
+	void insert_element(Element&& element, std::size_t key_hash)
+	{
+		if constexpr(hash_map_detail::is_std_pair_like<Element>::value)
+		{
+			emplace_hashed(key_hash, std::forward<Element>(element).first, std::forward<Element>(element).second);
+		}
+		else
+		{
+			emplace_hashed(key_hash, std::forward<Element>(element).key, std::forward<Element>(element).value);
+		}
+	}
+
+	template<typename Element, typename OnDuplicate>
+	void insert_merging(const Element& element, std::size_t key_hash, OnDuplicate& on_duplicate)
+	{
+		const auto target = find_or_prepare_insert(element_key(element), key_hash);
+
+		if(target.found)
+		{
+			on_duplicate(found_slot(target).pair().value, element_value(element));
+		}
+		else
+		{
+			construct_at(target, element_key(element), element_value(element));
+		}
+	}
+
+	// adds the elements, clusters and memory of one table (the current or the previous one) to result
+	void collect_stats(hash_map_stats& result, const storage_type& slots, const control_type& ctrl) const
+	{
+		const auto mask = ctrl.size() / group_type::width - 1;
+
+		// a cluster that wraps around the end of the table continues with the one at its start
+		size_type leading = 0;
+		while(leading < ctrl.size() && ctrl[leading] != hash_map_detail::ctrl_empty) ++leading;
+
+		size_type cluster = 0;
+
+		for(size_type index = leading; index < ctrl.size(); ++index)
+		{
+			if(ctrl[index] == hash_map_detail::ctrl_empty)
+			{
+				cluster = 0;
+				continue;
+			}
+
+			result.longest_cluster = std::max(result.longest_cluster, ++cluster);
+		}
+
+		result.longest_cluster = std::max(result.longest_cluster, std::min(cluster + leading, size_type(ctrl.size())));
+
+		for(size_type index = 0; index < ctrl.size(); ++index)
+		{
+			if(!hash_map_detail::is_full(ctrl[index])) continue;
+
+			const auto distance = (index / group_type::width - ((slot_hash(slots[index]) >> 7) & mask)) & mask;
+
+			if(distance >= result.probe_histogram.size()) result.probe_histogram.resize(distance + 1);
+			++result.probe_histogram[distance];
+		}
+
+		result.allocated_bytes += slots.size() * sizeof(slot_type) + ctrl.size() * sizeof(ctrl_type);
+	}
+
+	template<typename Iterator, typename Ctrl, typename Slot>
+	static void split_slots(std::vector<slot_range<Iterator>>& ranges, Ctrl* ctrl, Slot* slots, size_type slot_count, size_type parts)
+	{
+		parts = std::max<size_type>(parts, 1);
+
+		for(size_type part = 0; part < parts; ++part)
+		{
+			const auto first = slot_count * part / parts;
+			const auto last = slot_count * (part + 1) / parts;
+
+			slot_range<Iterator> range{};
+			range.first = Iterator{ ctrl + first, ctrl + last, slots + first }.skip_free();
+			range.last = Iterator{ ctrl + last, ctrl + last, slots + last };
+
+			ranges.push_back(range);
+		}
+	}
+
+	template<typename Ranges, typename ParallelFor, typename F>
+	static void for_each_range(const Ranges& ranges, ParallelFor& parallel_for, F& fn)
+	{
+		std::vector<std::exception_ptr> errors(ranges.size());
+
+		parallel_for(ranges.size(), [&](size_type task) {
+			try
+			{
+				for(auto&& element : ranges[task])
+				{
+					fn(element);
+				}
+			}
+			catch(...)
+			{
+				errors[task] = std::current_exception();
+			}
+		});
+
+		rethrow_first(errors);
+	}
+
+	static void rethrow_first(const std::vector<std::exception_ptr>& errors)
+	{
+		for(const auto& error : errors)
+		{
+			if(error) std::rethrow_exception(error);
+		}
+	}
+
+	void prefetch_home_group(std::size_t key_hash) const noexcept
+	{
+		const auto base = home_group(key_hash) * group_type::width;
+
+		hash_map_detail::prefetch(&control[base]);
+		hash_map_detail::prefetch(&storage[base]);
+	}
+
+	// capacities are powers of two (and at least one group), so a group index is just masked hash bits
+	size_type round_capacity(size_type capacity) const
+	{
+		if(capacity > max_capacity()) throw std::length_error{ "hash_map capacity exceeds max_size()" };
+		return hash_map_detail::next_power_of_two(std::max<size_type>(capacity, group_type::width));
+	}
+
+	// largest power of two whose slots and control bytes can still be allocated
+	size_type max_capacity() const noexcept
+	{
+		const auto slots = std::allocator_traits<rebind_alloc<slot_type>>::max_size(storage.get_allocator());
+		const auto limit = std::min<size_type>(slots, std::numeric_limits<size_type>::max() / (sizeof(slot_type) + sizeof(ctrl_type)));
+
+		auto capacity = (std::numeric_limits<size_type>::max() >> 1) + 1;
+		while(capacity > limit) capacity >>= 1;
+
+		return capacity;
+	}
+
+	// number of elements (and tombstones) a table with the given capacity may hold
+	size_type limit_for(size_type capacity) const noexcept
+	{
+		return size_type(policy.max_load_factor * capacity);
+	}
+
+	// smallest allowed capacity that can hold elements without exceeding the max load factor; throws
+	// std::length_error for more than max_size() elements
+	size_type capacity_for(size_type elements) const
+	{
+		if(elements > max_size()) throw std::length_error{ "hash_map size exceeds max_size()" };
+
+		// elements / max_load_factor is at most max_capacity() up to rounding, which the clamp takes care of
+		const auto needed = std::min(std::ceil(elements / policy.max_load_factor), double(max_capacity()));
+		auto capacity = round_capacity(std::max<size_type>(policy.min_capacity, size_type(needed)));
+		while(limit_for(capacity) < elements) capacity *= 2;
+		return capacity;
+	}
+
+	void grow()
+	{
+		const auto grown = std::min(std::ceil(capacity() * policy.growth_factor), double(max_capacity()));
+		const auto new_capacity = std::max(round_capacity(size_type(grown)), capacity_for(size() + 1));
+
+		if(policy.incremental_step == 0)
+		{
+			rehash_to(new_capacity);
+			return;
+		}
+
+		// the new table is sized for all elements, so the previous migration only has to be finished
+		// early if the new table fills up before it is done
+		finish_migration();
+
+		migration.storage = std::exchange(storage, storage_type(new_capacity, storage.get_allocator()));
+		migration.control = std::exchange(control, control_type(new_capacity, hash_map_detail::ctrl_empty, control.get_allocator()));
+		migration.next = 0;
+		tombstones = 0;
+		growth_limit = limit_for(capacity());
+
+		migrate_step();
+	}
+
+	// moves the elements of the next incremental_step slots of the previous table into the new one
+	void migrate_step()
+	{
+		if(!rehashing()) return;
+
+		const auto last = std::min(migration.next + policy.incremental_step, migration.control.size());
+
+		for(; migration.next < last; ++migration.next)
+		{
+			migrate_slot(migration.next);
+		}
+
+		if(migration.next == migration.control.size()) release_migration();
+	}
+
+	void finish_migration()
+	{
+		if(!rehashing()) return;
+
+		for(; migration.next < migration.control.size(); ++migration.next)
+		{
+			migrate_slot(migration.next);
+		}
+
+		release_migration();
+	}
+
+	void migrate_slot(size_type index)
+	{
+		if(!hash_map_detail::is_full(migration.control[index])) return;
+
+		auto& slot = migration.storage[index];
+		const auto target = prepare_insert(slot_hash(slot));
+
+		storage[target].relocate(slot);
+		if(control[target] == hash_map_detail::ctrl_deleted) --tombstones;
+		control[target] = migration.control[index];
+
+		// keeps the probe sequences of the elements still left in the previous table intact
+		migration.control[index] = hash_map_detail::ctrl_deleted;
+	}
+
+	// drops the emptied previous table; the replacements keep its allocator
+	void release_migration() noexcept
+	{
+		migration.storage = storage_type(migration.storage.get_allocator());
+		migration.control = control_type(migration.control.get_allocator());
+		migration.next = 0;
+	}
+
+	bool in_migration(const ctrl_type* ctrl) const noexcept
+	{
+		return rehashing() && ctrl >= migration.control.data() && ctrl < migration.control.data() + migration.control.size();
+	}
+
+	// an element either lives in the current table or in the previous one during incremental growth
+	struct location
+	{
+		size_type index;
+		bool migrating;
+	};
+
+	template<typename K>
+	location locate(const K& key) const noexcept { return empty() ? location{ npos, false } : locate(key, hash_of(key)); }
+
+	template<typename K>
+	location locate(const K& key, std::size_t key_hash) const noexcept
+	{
+		if(empty()) return { npos, false };
+
+		if(const auto index = probe(key, key_hash, storage, control); index != npos) return { index, false };
+		if(rehashing()) return { probe(key, key_hash, migration.storage, migration.control), true };
+
+		return { npos, false };
+	}
+
+	template<typename ForwardIt, typename Visitor>
+	void locate_many(ForwardIt first, ForwardIt last, Visitor&& visit) const
+	{
+		static_assert(hash_map_detail::is_forward_iterator<ForwardIt>, "batched lookups pass over each block twice");
+
+		// a moved-from map has no table to prefetch from
+		if(empty())
+		{
+			for(; first != last; ++first)
+			{
+				visit(location{ npos, false });
+			}
+
+			return;
+		}
+
+		std::size_t hashes[batch_size];
+
+		while(first != last)
+		{
+			size_type block = 0;
+
+			for(auto iter = first; iter != last && block < batch_size; ++iter, ++block)
+			{
+				hashes[block] = hash_of(*iter);
+				prefetch_home_group(hashes[block]);
+			}
+
+			for(size_type index = 0; index < block; ++index, ++first)
+			{
+				visit(locate(*first, hashes[index]));
+			}
+		}
+	}
 
-	// queries
+	iterator iterator_at(location where) noexcept
+	{
+		if(where.index == npos) return end();
+		return where.migrating ? make_migration_iterator(where.index) : make_iterator(where.index);
+	}
 
-	bool empty() const noexcept { return count == 0; }
-	size_type size() const noexcept { return count; }
-	size_type capacity() const noexcept { return storage.capacity(); }
+	const_iterator iterator_at(location where) const noexcept
+	{
+		if(where.index == npos) return end();
+		return where.migrating ? make_migration_iterator(where.index) : make_iterator(where.index);
+	}
+
+	// where a key is, or where it has to go
+	struct probe_result
+	{
+		size_type index;
+		std::size_t hash;
+		bool found;
+		bool migrating;
+	};
+
+	// Walks the probe sequence of key once, remembering the first free slot on the way. If key is not
+	// present, the table is grown or purged as needed and the returned index is the slot to construct
+	// the new element in; only growth (and Robin Hood insertion) has to look at the table again.
+	template<typename K>
+	probe_result find_or_prepare_insert(const K& key, std::size_t key_hash)
+	{
+		migrate_step();
 
-	double load_factor() const noexcept { return double(size()) / capacity(); }
-	double max_load_factor() const noexcept { return 0.5; }
+		const auto tag = hash_map_detail::tag_of(key_hash);
+		auto group = home_group(key_hash);
+		auto free = npos;
 
-	// iterator
+		for(size_type probes = 0; probes < group_count(); ++probes)
+		{
+			const auto base = group * group_type::width;
+			const group_type candidates{ &control[base] };
+
+			for(auto offset : candidates.match(tag))
+			{
+				const auto& slot = storage[base + offset];
+				if(slot.matches(key_hash) && equal(slot.pair().key, key)) return { base + offset, key_hash, true, false };
+			}
+
+			if(free == npos)
+			{
+				if(const auto free_slots = candidates.match_empty_or_deleted()) free = base + free_slots.lowest();
+			}
+
+			if(candidates.match_empty()) break;
+
+			group = next_group(group);
+		}
+
+		if(rehashing())
+		{
+			if(const auto index = probe(key, key_hash, migration.storage, migration.control); index != npos)
+			{
+				return { index, key_hash, true, true };
+			}
+		}
+
+		if(make_space_for_insert() || robin_hood)
+		{
+			free = prepare_insert(key_hash);
+		}
+
+		return { free, key_hash, false, false };
+	}
 
-	iterator begin() noexcept
+	// grows or purges the table if one more element would exceed the load limit, returns whether
+	// elements have been moved
+	bool make_space_for_insert()
 	{
-		return iterator{
-			std::find_if(
-				std::begin(storage),
-				std::end(storage),
-				[&](auto& slot) { return slot.state == slot_type::full; }),
-			storage.end()
-		};
+		if(size() + 1 > growth_limit)
+		{
+			grow();
+			return true;
+		}
+
+		if(size() + tombstones + 1 > growth_limit)
+		{
+			// tombstones count towards the load as well, since probes have to skip them; if they take
+			// up a sizeable share of the table they are cleared in place, otherwise the table grows
+			if(tombstones * purge_divisor >= capacity()) purge();
+			else grow();
+
+			return true;
+		}
+
+		return false;
 	}
 
-	const_iterator begin() const noexcept
+	slot_type& found_slot(const probe_result& target) noexcept
 	{
-		return {
-			std::find_if(
-				std::begin(storage),
-				std::end(storage),
-				[&](auto& slot) { return slot.state == slot_type::full; })
-		};
+		return target.migrating ? migration.storage[target.index] : storage[target.index];
 	}
 
-	const_iterator cbegin() const noexcept { return begin(); }
+	// constructs a new element in the free slot found by find_or_prepare_insert
+	template<typename K, typename... Args>
+	iterator construct_at(const probe_result& target, K&& key, Args&&... args)
+	{
+		auto& slot = storage[target.index];
 
-	iterator end() noexcept { return iterator{ storage.end(), storage.end() }; }
-	const_iterator end() const noexcept { return { storage.end() }; }
-	const_iterator cend() const noexcept { return end(); }
+		slot.set(std::forward<K>(key), std::forward<Args>(args)...);
+		slot.store(target.hash);
 
-private:
-	void rehash(size_type newCapacity)
+		if(control[target.index] == hash_map_detail::ctrl_deleted) --tombstones;
+		control[target.index] = hash_map_detail::tag_of(target.hash);
+		++count;
+
+		return make_iterator(target.index);
+	}
+
+	// K is key_type (possibly const / reference qualified) or, for transparent lookups, anything a
+	// key_type can be constructed from; the key is converted, copied or moved exactly once
+	template<typename K, typename... Args>
+	iterator emplace_impl(K&& key, Args&&... args)
+	{
+		const auto key_hash = hash_of(key);
+		return emplace_hashed(key_hash, std::forward<K>(key), std::forward<Args>(args)...);
+	}
+
+	template<typename K, typename... Args>
+	iterator emplace_hashed(std::size_t key_hash, K&& key, Args&&... args)
+	{
+		const auto target = find_or_prepare_insert(key, key_hash);
+
+		if(target.found)
+		{
+			found_slot(target).pair().value = value_type(std::forward<Args>(args)...);
+			return iterator_at({ target.index, target.migrating });
+		}
+
+		return construct_at(target, std::forward<K>(key), std::forward<Args>(args)...);
+	}
+
+	template<typename K, typename... Args>
+	std::pair<iterator, bool> try_emplace_impl(std::size_t key_hash, K&& key, Args&&... args)
+	{
+		const auto target = find_or_prepare_insert(key, key_hash);
+
+		if(target.found) return { iterator_at({ target.index, target.migrating }), false };
+
+		return { construct_at(target, std::forward<K>(key), std::forward<Args>(args)...), true };
+	}
+
+	template<typename K, typename M>
+	std::pair<iterator, bool> insert_or_assign_impl(std::size_t key_hash, K&& key, M&& value)
+	{
+		const auto target = find_or_prepare_insert(key, key_hash);
+
+		if(target.found)
+		{
+			found_slot(target).pair().value = std::forward<M>(value);
+			return { iterator_at({ target.index, target.migrating }), false };
+		}
+
+		return { construct_at(target, std::forward<K>(key), std::forward<M>(value)), true };
+	}
+
+	// hash of the element in a full slot, taken from the slot itself if hashes are stored
+	std::size_t slot_hash(const slot_type& slot) const noexcept
+	{
+		if constexpr(store_hash)
+		{
+			return slot.hash;
+		}
+		else
+		{
+			return hash_of(slot.pair().key);
+		}
+	}
+
+	std::size_t hash_at(size_type index) const noexcept { return slot_hash(storage[index]); }
+
+	template<typename K>
+	std::size_t hash_of(const K& key) const noexcept { return hash_map_detail::hash_key(hash, key); }
+
+	iterator make_iterator(size_type index) noexcept
+	{
+		return iterator{ control.data() + index, control.data() + capacity(), storage.data() + index };
+	}
+
+	const_iterator make_iterator(size_type index) const noexcept
+	{
+		return const_iterator{ control.data() + index, control.data() + capacity(), storage.data() + index };
+	}
+
+	iterator make_migration_iterator(size_type index) noexcept
+	{
+		const auto& old = migration.control;
+		return iterator{ old.data() + index, old.data() + old.size(), migration.storage.data() + index, control.data(), control.data() + capacity(), storage.data() };
+	}
+
+	const_iterator make_migration_iterator(size_type index) const noexcept
+	{
+		const auto& old = migration.control;
+		return const_iterator{ old.data() + index, old.data() + old.size(), migration.storage.data() + index, control.data(), control.data() + capacity(), storage.data() };
+	}
+
+	// copies the elements (and tombstones) of other into the empty table of the same capacity
+	void copy_elements(const hash_map& other)
+	{
+		for(size_type index = 0; index < other.capacity(); ++index)
+		{
+			if(hash_map_detail::is_full(other.control[index]))
+			{
+				const auto& pair = other.storage[index].pair();
+				storage[index].set(pair.key, pair.value);
+				static_cast<hash_field&>(storage[index]) = other.storage[index];
+				control[index] = other.control[index];
+				++count;
+			}
+		}
+
+		// tombstones have to be kept as well, they might be part of a probe sequence
+		std::copy(other.control.begin(), other.control.end(), control.begin());
+		tombstones = other.tombstones;
+
+		// a copy does not continue an incremental migration, it takes over the remaining elements directly
+		for(size_type index = 0; index < other.migration.control.size(); ++index)
+		{
+			if(hash_map_detail::is_full(other.migration.control[index]))
+			{
+				const auto& slot = other.migration.storage[index];
+				const auto target = prepare_insert(other.slot_hash(slot));
+
+				storage[target].set(slot.pair().key, slot.pair().value);
+				static_cast<hash_field&>(storage[target]) = slot;
+				if(control[target] == hash_map_detail::ctrl_deleted) --tombstones;
+				control[target] = other.migration.control[index];
+				++count;
+			}
+		}
+	}
+
+	void release_all() noexcept(std::is_nothrow_destructible_v<key_type> && std::is_nothrow_destructible_v<value_type>)
+	{
+		if constexpr(!std::is_trivially_destructible_v<key_value_pair>)
+		{
+			for(size_type index = 0; index < control.size(); ++index)
+			{
+				if(hash_map_detail::is_full(control[index])) storage[index].release();
+			}
+
+			for(size_type index = 0; index < migration.control.size(); ++index)
+			{
+				if(hash_map_detail::is_full(migration.control[index])) migration.storage[index].release();
+			}
+		}
+	}
+
+	// Places every element again at the first free slot of its probe sequence, within the same slot
+	// array: elements are swapped into place one by one, so no second table is needed. This clears
+	// all tombstones, and after the arrays grew, it spreads the elements over the larger table.
+	void place_again()
+	{
+		// mark every element as "not yet placed" (deleted) and every tombstone as empty
+
+		for(auto& ctrl : control)
+		{
+			ctrl = hash_map_detail::is_full(ctrl) ? hash_map_detail::ctrl_deleted : hash_map_detail::ctrl_empty;
+		}
+
+		for(size_type index = 0; index < capacity(); ++index)
+		{
+			while(control[index] == hash_map_detail::ctrl_deleted)
+			{
+				const auto key_hash = hash_at(index);
+				const auto tag = hash_map_detail::tag_of(key_hash);
+				const auto target = probe_free(key_hash);
+
+				if(target / group_type::width == index / group_type::width)
+				{
+					control[index] = tag;
+				}
+				else if(control[target] == hash_map_detail::ctrl_empty)
+				{
+					storage[target].relocate(storage[index]);
+
+					control[target] = tag;
+					control[index] = hash_map_detail::ctrl_empty;
+				}
+				else
+				{
+					// target holds another element that has not been placed yet: swap both and
+					// continue with the element that is now at index
+					swap_slots(index, target);
+					control[target] = tag;
+				}
+			}
+		}
+
+
+		tombstones = 0;
+	}
+
+	// Grows the table to new_capacity slots without a second slot array: the allocator extends the
+	// block where it is or moves its pages (see hash_map_detail::can_reallocate), and the elements
+	// are placed again within it, so the old and the new table never take up memory side by side.
+	// Returns false, with the table unchanged, if the allocator cannot resize the block.
+	bool grow_in_place(size_type new_capacity)
+	{
+		if(capacity() == 0 || new_capacity <= capacity()) return false;
+
+		// the control bytes are small next to the slots and simply copied; they are allocated first so
+		// that a failure leaves the table as it is
+		control_type new_control(new_capacity, hash_map_detail::ctrl_empty, control.get_allocator());
+		if(!storage.grow_in_place(new_capacity)) return false;
+
+		std::copy(control.begin(), control.end(), new_control.begin());
+		control = std::move(new_control);
+		growth_limit = limit_for(capacity());
+
+		place_again();
+		return true;
+	}
+
+	void rehash_to(size_type newCapacity)
+	{
+		const auto tasks = std::min<size_type>(policy.rehash_threads, size() / parallel_grain);
+		rehash_to(newCapacity, std::max<size_type>(tasks, 1), hash_map_detail::thread_per_task{});
+	}
+
+	template<typename ParallelFor>
+	void rehash_to(size_type newCapacity, size_type tasks, ParallelFor&& parallel_for)
+	{
+		finish_migration();
+
+		if constexpr(grows_in_place)
+		{
+			if(grow_in_place(round_capacity(newCapacity))) return;
+		}
+
+		auto old_storage = std::move(storage);
+		auto old_control = std::move(control);
+
+		storage = storage_type(round_capacity(newCapacity), old_storage.get_allocator());
+		control = control_type(storage.size(), hash_map_detail::ctrl_empty, old_control.get_allocator());
+		tombstones = 0;
+		growth_limit = limit_for(capacity());
+
+		if constexpr(parallel_rehash)
+		{
+			if(tasks > 1)
+			{
+				place_parallel(old_storage, old_control, tasks, parallel_for);
+				return;
+			}
+		}
+
+		for(size_type index = 0; index < old_control.size(); ++index)
+		{
+			if(hash_map_detail::is_full(old_control[index]))
+			{
+				auto& slot = old_storage[index];
+				const auto target = prepare_insert(slot_hash(slot));
+
+				storage[target].relocate(slot);
+				control[target] = old_control[index];
+			}
+		}
+	}
+
+	// moves the elements of a previous table into the empty current one, every task taking one range
+	// of the old slots; the tasks claim free slots in the new table with atomic control byte updates
+	template<typename ParallelFor>
+	void place_parallel(storage_type& old_storage, const control_type& old_control, size_type tasks, ParallelFor& parallel_for) noexcept
+	{
+		const auto old_capacity = old_control.size();
+
+		parallel_for(tasks, [&](size_type task) {
+			const auto last = old_capacity * (task + 1) / tasks;
+
+			for(auto index = old_capacity * task / tasks; index < last; ++index)
+			{
+				if(hash_map_detail::is_full(old_control[index]))
+				{
+					auto& slot = old_storage[index];
+					storage[claim_free(slot_hash(slot))].relocate(slot);
+				}
+			}
+		});
+	}
+
+	// claims the first free slot along the probe sequence of key_hash while other threads fill the
+	// table too; nothing is ever erased meanwhile, so lookups still find the element
+	size_type claim_free(std::size_t key_hash) noexcept
+	{
+		const auto tag = hash_map_detail::tag_of(key_hash);
+
+		for(auto group = home_group(key_hash);; group = next_group(group))
+		{
+			const auto base = group * group_type::width;
+
+			for(size_type offset = 0; offset < group_type::width; ++offset)
+			{
+				const auto ctrl = &control[base + offset];
+				if(hash_map_detail::load_relaxed(ctrl) == hash_map_detail::ctrl_empty && hash_map_detail::claim_empty(ctrl, tag)) return base + offset;
+			}
+		}
+	}
+
+	// the low 7 bits of a hash are its tag, the remaining bits select the home group
+	size_type group_count() const noexcept { return capacity() / group_type::width; }
+	size_type group_mask() const noexcept { return group_count() - 1; }
+	size_type home_group(std::size_t key_hash) const noexcept { return (key_hash >> 7) & group_mask(); }
+	size_type next_group(size_type group) const noexcept { return (group + 1) & group_mask(); }
+
+	// scans the probe sequence of key one group of control bytes at a time; only slots whose tag
+	// matches are compared against key, and the first group with an empty slot ends the search
+	template<typename K>
+	size_type probe(const K& key, std::size_t key_hash, const storage_type& slots, const control_type& ctrl) const noexcept
+	{
+		return probe_table(equal, key, key_hash, slots.data(), ctrl.data(), ctrl.size());
+	}
+
+	// the same on a table that does not belong to a map, like a mapped snapshot
+	template<typename K>
+	static size_type probe_table(const KeyEqual& compare, const K& key, std::size_t key_hash, const slot_type* slots, const ctrl_type* ctrl, size_type capacity) noexcept
+	{
+		const auto tag = hash_map_detail::tag_of(key_hash);
+		const auto mask = capacity / group_type::width - 1;
+		auto group = (key_hash >> 7) & mask;
+
+		for(size_type probes = 0; probes <= mask; ++probes)
+		{
+			const auto base = group * group_type::width;
+			const group_type candidates{ &ctrl[base] };
+
+			for(auto offset : candidates.match(tag))
+			{
+				const auto& slot = slots[base + offset];
+				if(slot.matches(key_hash) && compare(slot.pair().key, key)) return base + offset;
+			}
+
+			if(candidates.match_empty()) return npos;
+
+			group = (group + 1) & mask;
+		}
+
+		return npos;
+	}
+
+	// build_parallel() splits the table into parts of whole groups, one per thread
+	size_type part_of(std::size_t key_hash, size_type parts) const noexcept
+	{
+		return home_group(key_hash) * parts / group_count();
+	}
+
+	// first group after part, matching part_of()
+	size_type part_end(size_type part, size_type parts) const noexcept
+	{
+		return (group_count() * (part + 1) + parts - 1) / parts;
+	}
+
+	// slot of key or the free slot for it in a table without tombstones, probing from its home group
+	// up to last_group only; the index is npos if the probe sequence leaves the part first
+	template<typename K>
+	probe_result probe_part(const K& key, std::size_t key_hash, size_type last_group) const noexcept
+	{
+		const auto tag = hash_map_detail::tag_of(key_hash);
+
+		for(auto group = home_group(key_hash); group < last_group; ++group)
+		{
+			const auto base = group * group_type::width;
+			const group_type candidates{ &control[base] };
+
+			for(auto offset : candidates.match(tag))
+			{
+				const auto& slot = storage[base + offset];
+				if(slot.matches(key_hash) && equal(slot.pair().key, key)) return { base + offset, key_hash, true, false };
+			}
+
+			if(const auto free = candidates.match_empty()) return { base + free.lowest(), key_hash, false, false };
+		}
+
+		return { npos, key_hash, false, false };
+	}
+
+	// first empty or deleted slot on the probe sequence of key_hash; there always is one as long as
+	// the load factor stays below 1
+	size_type probe_free(std::size_t key_hash) const noexcept
+	{
+		auto group = home_group(key_hash);
+
+		while(true)
+		{
+			const auto base = group * group_type::width;
+
+			if(const auto free = group_type{ &control[base] }.match_empty_or_deleted())
+			{
+				return base + free.lowest();
+			}
+
+			group = next_group(group);
+		}
+	}
+
+	// returns a free slot for a new element with key_hash
+	size_type prepare_insert(std::size_t key_hash)
+	{
+		if constexpr(robin_hood)
+		{
+			return make_room(key_hash);
+		}
+		else
+		{
+			return probe_free(key_hash);
+		}
+	}
+
+	// number of groups between the slot at index and the home group of its element
+	size_type displacement(size_type index) const noexcept
 	{
-		auto copy = std::move(storage);
-		storage.clear();
-		count = 0;
-		storage.resize(newCapacity);
-		for(auto& slot : copy)
+		return (index / group_type::width - home_group(hash_at(index))) & group_mask();
+	}
+
+	void swap_slots(size_type first, size_type second)
+	{
+		swap_slots(storage[first], storage[second]);
+	}
+
+	static void swap_slots(slot_type& first, slot_type& second)
+	{
+		slot_type temporary;
+
+		temporary.relocate(first);
+		first.relocate(second);
+		second.relocate(temporary);
+	}
+
+	// moves the element at from into the free slot at to, leaving from empty
+	void move_slot(size_type from, size_type to)
+	{
+		storage[to].relocate(storage[from]);
+
+		control[to] = control[from];
+		control[from] = hash_map_detail::ctrl_empty;
+	}
+
+	// Robin Hood insertion on group granularity: whenever the probe sequence runs through a full
+	// group, the least displaced resident that is closer to its home than the element being placed
+	// gets evicted and continues down the probe sequence in its place. The first evicted slot is the
+	// one returned for the new element; every later eviction swaps the element carried along so far
+	// into the victim's slot, and the last one carried ends up in the first empty slot.
+	size_type make_room(std::size_t key_hash)
+	{
+		auto group = home_group(key_hash);
+		size_type distance = 0;
+		auto target = npos;
+
+		// the slot for the carried element only comes to life with the first eviction, like the table's
+		// slots it is raw storage until then
+		std::aligned_storage_t<sizeof(slot_type), alignof(slot_type)> carried_storage;
+		slot_type* carried = nullptr;
+		ctrl_type carried_tag = hash_map_detail::ctrl_empty;
+
+		while(true)
 		{
-			if(slot.state == slot_type::full)
+			const auto base = group * group_type::width;
+			const group_type candidates{ &control[base] };
+
+			if(const auto free = candidates.match_empty())
+			{
+				const auto index = base + free.lowest();
+				if(target == npos) return index;
+
+				storage[index].relocate(*carried);
+				control[index] = carried_tag;
+				control[target] = hash_map_detail::ctrl_empty;
+				return target;
+			}
+
+			auto victim = npos;
+			auto victim_distance = distance;
+
+			for(auto offset : candidates.match_full())
+			{
+				if(const auto resident_distance = displacement(base + offset); resident_distance < victim_distance)
+				{
+					victim = base + offset;
+					victim_distance = resident_distance;
+				}
+			}
+
+			if(victim != npos)
 			{
-				insert(slot.pair().key, std::move(slot.pair().value));
+				if(target == npos)
+				{
+					// the slot keeps its control byte and stored hash until the carried element is placed
+					carried = ::new(static_cast<void*>(&carried_storage)) slot_type;
+					carried->relocate(storage[victim]);
+					carried_tag = control[victim];
+					target = victim;
+				}
+				else
+				{
+					swap_slots(storage[victim], *carried);
+					std::swap(control[victim], carried_tag);
+				}
+
+				distance = victim_distance;
 			}
+
+			group = next_group(group);
+			++distance;
 		}
 	}
 
-	typename storage_type::iterator probe(
-		typename storage_type::iterator slot,
-		const typename slot_type::state_type expected,
-		const typename slot_type::state_type skip = slot_type::none) noexcept
+	// backward shift deletion: pulls the most displaced element of the following group into the
+	// hole, until the following group has no element that was displaced past the hole's group
+	void shift_back(size_type hole)
 	{
-		if(slot == storage.end()) slot = storage.begin();
+		auto group = hole / group_type::width;
 
-		if((slot->state & expected) == slot_type::none)
+		while(true)
 		{
-			do
+			const auto next = next_group(group);
+			const auto base = next * group_type::width;
+
+			auto candidate = npos;
+			size_type candidate_distance = 0;
+
+			for(auto offset : group_type{ &control[base] }.match_full())
 			{
-				++slot;
-				if(slot == storage.end()) slot = storage.begin();
+				if(const auto resident_distance = displacement(base + offset); resident_distance > candidate_distance)
+				{
+					candidate = base + offset;
+					candidate_distance = resident_distance;
+				}
 			}
-			while((slot->state & skip) != slot_type::none);
+
+			if(candidate == npos) break;
+
+			move_slot(candidate, hole);
+			hole = candidate;
+			group = next;
 		}
 
-		return slot;
+		control[hole] = hash_map_detail::ctrl_empty;
 	}
 };
+
+namespace pmr
+{
+	// hash_map that takes its memory from a std::pmr::memory_resource, e.g. a monotonic_buffer_resource
+	// for scratch maps that are released all at once
+	template<
+		typename Key,
+		typename Value,
+		typename Hash = std::hash<Key>,
+		typename KeyEqual = std::equal_to<Key>,
+		typename Probing = hash_map_probing::tombstones,
+		typename GrowthPolicy = hash_map_growth_policy>
+	using hash_map = ::hash_map<Key, Value, Hash, KeyEqual, Probing, GrowthPolicy, std::pmr::polymorphic_allocator<std::pair<const Key, Value>>>;
+}
@@ -0,0 +1,369 @@
+#pragma once
+
+#include "hash_map.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace hash_map_detail
+{
+	// Layout of a snapshot file: this header, the control bytes at control_offset and the slot array
+	// at slots_offset, both copied verbatim from the table. Everything that decides whether the bytes
+	// can be used as they are is recorded, so that a view refuses files from other builds.
+	struct snapshot_header
+	{
+		static constexpr char file_magic[8] = { 'H', 'M', 'S', 'N', 'A', 'P', '\0', '\0' };
+		static constexpr std::uint32_t file_version = 2;
+		static constexpr std::uint32_t file_byte_order = 0x01020304;
+
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t byte_order;
+		std::uint32_t group_width;
+		std::uint32_t stores_hash;
+		std::uint64_t hash_size;
+		std::uint64_t key_size;
+		std::uint64_t value_size;
+		std::uint64_t slot_size;
+		std::uint64_t capacity;
+		std::uint64_t size;
+		std::uint64_t control_offset;
+		std::uint64_t slots_offset;
+	};
+
+	// sections start on cache line boundaries, which satisfies the alignment of any slot
+	constexpr std::uint64_t snapshot_alignment = 64;
+
+	constexpr std::uint64_t snapshot_align(std::uint64_t offset) noexcept
+	{
+		return (offset + snapshot_alignment - 1) & ~(snapshot_alignment - 1);
+	}
+
+	// whole file mapped read-only; the pages are shared between all processes mapping the same file
+	class mapped_file
+	{
+	public:
+		explicit mapped_file(const std::string& path)
+		{
+#if defined(_WIN32)
+			const auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if(file == INVALID_HANDLE_VALUE) throw std::runtime_error{ "cannot open snapshot " + path };
+
+			LARGE_INTEGER file_size;
+			GetFileSizeEx(file, &file_size);
+			length = std::size_t(file_size.QuadPart);
+
+			const auto mapping = length == 0 ? nullptr : CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			CloseHandle(file);
+
+			if(mapping != nullptr)
+			{
+				memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(mapping);
+			}
+
+			if(memory == nullptr) throw std::runtime_error{ "cannot map snapshot " + path };
+#else
+			const auto file = ::open(path.c_str(), O_RDONLY);
+			if(file < 0) throw std::runtime_error{ "cannot open snapshot " + path };
+
+			struct stat status;
+			if(::fstat(file, &status) == 0 && status.st_size > 0)
+			{
+				length = std::size_t(status.st_size);
+				memory = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, file, 0);
+			}
+
+			::close(file);
+
+			if(memory == nullptr || memory == MAP_FAILED)
+			{
+				memory = nullptr;
+				throw std::runtime_error{ "cannot map snapshot " + path };
+			}
+#endif
+		}
+
+		mapped_file(mapped_file&& other) noexcept
+			: memory(std::exchange(other.memory, nullptr)),
+			  length(std::exchange(other.length, 0)) {}
+
+		mapped_file& operator=(mapped_file&& other) noexcept
+		{
+			std::swap(memory, other.memory);
+			std::swap(length, other.length);
+			return *this;
+		}
+
+		~mapped_file()
+		{
+			if(memory == nullptr) return;
+
+#if defined(_WIN32)
+			UnmapViewOfFile(memory);
+#else
+			::munmap(memory, length);
+#endif
+		}
+
+		const unsigned char* data() const noexcept { return static_cast<const unsigned char*>(memory); }
+		std::size_t size() const noexcept { return length; }
+
+	private:
+		void* memory = nullptr;
+		std::size_t length = 0;
+	};
+
+	// name of the file next to path that a new snapshot is written to before it replaces path
+	inline std::string temporary_snapshot_path(const std::string& path)
+	{
+		static std::atomic<unsigned> counter{ 0 };
+
+#if defined(_WIN32)
+		const auto process = static_cast<unsigned long>(GetCurrentProcessId());
+#else
+		const auto process = static_cast<long>(::getpid());
+#endif
+
+		return path + ".tmp." + std::to_string(process) + "." + std::to_string(counter++);
+	}
+
+	// writes the contents of the file at path through to the disk, so that a crash after it replaced
+	// another file cannot leave an incomplete snapshot behind
+	inline bool sync_file(const std::string& path) noexcept
+	{
+#if defined(_WIN32)
+		const auto file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if(file == INVALID_HANDLE_VALUE) return false;
+
+		const auto synced = FlushFileBuffers(file) != 0;
+		CloseHandle(file);
+#else
+		const auto file = ::open(path.c_str(), O_WRONLY);
+		if(file < 0) return false;
+
+		const auto synced = ::fsync(file) == 0;
+		::close(file);
+#endif
+
+		return synced;
+	}
+
+	// atomically replaces the file at to with the one at from; processes that mapped the previous
+	// file keep its contents until they unmap it
+	inline bool replace_file(const std::string& from, const std::string& to) noexcept
+	{
+#if defined(_WIN32)
+		return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+}
+
+// Read-only hash_map that answers lookups directly from a memory-mapped snapshot file, without
+// deserializing anything. Snapshots are written by save() (or save_snapshot()) from a map of the
+// same type, which requires trivially copyable keys and values. The hasher has to produce the same
+// hashes in every process that maps the file (std::hash of integers does, for example).
+template<typename Map>
+class hash_map_view
+{
+	using slot_type = typename Map::slot_type;
+	using ctrl_type = hash_map_detail::ctrl_type;
+	using header_type = hash_map_detail::snapshot_header;
+
+public:
+	using key_type = typename Map::key_type;
+	using value_type = typename Map::value_type;
+	using key_value_pair = typename Map::key_value_pair;
+	using hasher = typename Map::hasher;
+	using key_equal = typename Map::key_equal;
+	using size_type = typename Map::size_type;
+
+	static_assert(std::is_trivially_copyable_v<key_type> && std::is_trivially_copyable_v<value_type>, "snapshots store keys and values as raw bytes");
+	static_assert(alignof(slot_type) <= hash_map_detail::snapshot_alignment, "slots have to be aligned within the mapped file");
+
+	explicit hash_map_view(const std::string& path, const hasher& hash = hasher{}, const key_equal& equal = key_equal{})
+		: file(path),
+		  hash(hash),
+		  equal(equal)
+	{
+		if(file.size() < sizeof(header_type)) throw std::runtime_error{ "snapshot " + path + " is truncated" };
+
+		std::memcpy(&header, file.data(), sizeof(header_type));
+
+		if(std::memcmp(header.magic, header_type::file_magic, sizeof(header.magic)) != 0) throw std::runtime_error{ path + " is not a hash map snapshot" };
+		if(header.version != header_type::file_version) throw std::runtime_error{ "snapshot " + path + " has an unsupported version" };
+		if(header.group_width != hash_map_detail::group::width) throw std::runtime_error{ "snapshot " + path + " was written with a different group width" };
+		if(header.hash_size != sizeof(std::size_t)) throw std::runtime_error{ "snapshot " + path + " was written with a different hash width" };
+
+		// probing needs at least one whole group and masks group indices, every table a map creates is
+		// like that; anything else would send lookups past the end of the mapping
+		const auto capacity_is_valid = header.capacity >= hash_map_detail::group::width && (header.capacity & (header.capacity - 1)) == 0 && header.size <= header.capacity;
+		if(!capacity_is_valid) throw std::runtime_error{ "snapshot " + path + " has a corrupted header" };
+
+		const auto expected = expected_header(header.capacity, header.size);
+		if(std::memcmp(&header, &expected, sizeof(header_type)) != 0) throw std::runtime_error{ "snapshot " + path + " was written for a different map layout" };
+		if(header.slots_offset > file.size() || header.capacity > (file.size() - header.slots_offset) / sizeof(slot_type)) throw std::runtime_error{ "snapshot " + path + " is truncated" };
+
+		control = reinterpret_cast<const ctrl_type*>(file.data() + header.control_offset);
+		slots = reinterpret_cast<const slot_type*>(file.data() + header.slots_offset);
+	}
+
+	// writes map into a snapshot file at path, atomically replacing any existing file
+	static void save(const Map& map, const std::string& path)
+	{
+		// a moved-from map has no table at all, an empty one is written instead
+		if(map.capacity() == 0)
+		{
+			save(Map{ 0, map.growth_policy() }, path);
+			return;
+		}
+
+		// a map in the middle of incremental growth has elements in two tables, a copy has one
+		if(map.rehashing())
+		{
+			save(Map{ map }, path);
+			return;
+		}
+
+		// the snapshot is written next to path and then renamed over it, so that views of the previous
+		// file (in this or other processes) never see it change or shrink underneath them
+		const auto temporary = hash_map_detail::temporary_snapshot_path(path);
+
+		try
+		{
+			write_file(map, temporary);
+
+			if(!hash_map_detail::sync_file(temporary) || !hash_map_detail::replace_file(temporary, path))
+			{
+				throw std::runtime_error{ "cannot write snapshot " + path };
+			}
+		}
+		catch(...)
+		{
+			std::remove(temporary.c_str());
+			throw;
+		}
+	}
+
+	// lookup
+
+	// the element with the given key, nullptr if there is none; valid as long as the view exists
+	const key_value_pair* find(const key_type& key) const noexcept
+	{
+		const auto index = Map::probe_table(equal, key, hash_map_detail::hash_key(hash, key), slots, control, capacity());
+		return index == Map::npos ? nullptr : &slots[index].pair();
+	}
+
+	bool contains(const key_type& key) const noexcept { return find(key) != nullptr; }
+
+	// queries
+
+	bool empty() const noexcept { return size() == 0; }
+	size_type size() const noexcept { return size_type(header.size); }
+	size_type capacity() const noexcept { return size_type(header.capacity); }
+
+private:
+	hash_map_detail::mapped_file file;
+	header_type header{};
+	const ctrl_type* control = nullptr;
+	const slot_type* slots = nullptr;
+	hasher hash;
+	key_equal equal;
+
+	static header_type expected_header(std::uint64_t capacity, std::uint64_t size) noexcept
+	{
+		header_type header{};
+
+		std::memcpy(header.magic, header_type::file_magic, sizeof(header.magic));
+		header.version = header_type::file_version;
+		header.byte_order = header_type::file_byte_order;
+		header.group_width = std::uint32_t(hash_map_detail::group::width);
+		header.stores_hash = Map::store_hash;
+		header.hash_size = sizeof(std::size_t);
+		header.key_size = sizeof(key_type);
+		header.value_size = sizeof(value_type);
+		header.slot_size = sizeof(slot_type);
+		header.capacity = capacity;
+		header.size = size;
+		header.control_offset = hash_map_detail::snapshot_align(sizeof(header_type));
+		header.slots_offset = hash_map_detail::snapshot_align(header.control_offset + capacity);
+
+		return header;
+	}
+
+	// writes the header, control bytes and slots of map into a new file at path
+	static void write_file(const Map& map, const std::string& path)
+	{
+		const auto header = expected_header(map.capacity(), map.size());
+
+		std::ofstream out{ path, std::ios::binary | std::ios::trunc };
+		if(!out) throw std::runtime_error{ "cannot create snapshot " + path };
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		pad(out, header.control_offset - sizeof(header));
+		out.write(reinterpret_cast<const char*>(map.control.data()), std::streamsize(map.capacity()));
+		pad(out, header.slots_offset - header.control_offset - map.capacity());
+
+		// only the stored hash, key and value of full slots are copied; free slots as well as the padding
+		// around and between the fields are written as zeros instead of whatever their memory holds
+		alignas(slot_type) unsigned char bytes[sizeof(slot_type)];
+
+		for(size_type index = 0; index < map.capacity(); ++index)
+		{
+			std::memset(bytes, 0, sizeof(slot_type));
+
+			if(hash_map_detail::is_full(map.control[index]))
+			{
+				const auto& slot = map.storage[index];
+
+				const auto copy_field = [&](const auto& field) {
+					const auto offset = reinterpret_cast<const unsigned char*>(&field) - reinterpret_cast<const unsigned char*>(&slot);
+					std::memcpy(bytes + offset, &field, sizeof(field));
+				};
+
+				if constexpr(Map::store_hash) copy_field(slot.hash);
+				copy_field(slot.pair().key);
+				copy_field(slot.pair().value);
+			}
+
+			out.write(reinterpret_cast<const char*>(bytes), sizeof(slot_type));
+		}
+
+		if(!out.flush()) throw std::runtime_error{ "cannot write snapshot " + path };
+	}
+
+	static void pad(std::ofstream& out, std::uint64_t bytes)
+	{
+		const char zeros[hash_map_detail::snapshot_alignment] = {};
+		out.write(zeros, std::streamsize(bytes));
+	}
+};
+
+template<typename Map>
+void save_snapshot(const Map& map, const std::string& path)
+{
+	hash_map_view<Map>::save(map, path);
+}
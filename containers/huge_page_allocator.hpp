@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace huge_pages
+{
+	// asks the kernel to back the mapping with transparent huge pages (madvise(MADV_HUGEPAGE)),
+	// which works without any system configuration
+	struct transparent {};
+
+	// maps the memory from the reserved huge page pool (MAP_HUGETLB), falling back to transparent
+	// huge pages if the pool is exhausted or not configured
+	struct reserved {};
+
+	// size of a huge page on x86-64 and the default on aarch64
+	constexpr std::size_t page_size = std::size_t(2) << 20;
+}
+
+// Allocator that maps large blocks (at least one huge page) directly with mmap and backs them with
+// huge pages, which cuts the TLB misses of random accesses into big tables. Blocks are returned to
+// the system as soon as they are deallocated. Smaller blocks, and all blocks on platforms other than
+// Linux, come from std::allocator.
+//
+//   hash_map<std::uint64_t, std::uint64_t, std::hash<std::uint64_t>, std::equal_to<std::uint64_t>,
+//            hash_map_probing::tombstones, hash_map_growth_policy,
+//            huge_page_allocator<std::pair<const std::uint64_t, std::uint64_t>>> table{};
+template<typename T, typename Pages = huge_pages::transparent>
+class huge_page_allocator
+{
+public:
+	using value_type = T;
+	using is_always_equal = std::true_type;
+
+	huge_page_allocator() noexcept = default;
+
+	template<typename U>
+	huge_page_allocator(const huge_page_allocator<U, Pages>&) noexcept { }
+
+	T* allocate(std::size_t n)
+	{
+#if defined(__linux__)
+		if(const auto bytes = mapped_size(n))
+		{
+			return static_cast<T*>(map(bytes));
+		}
+#endif
+
+		return std::allocator<T>{}.allocate(n);
+	}
+
+	void deallocate(T* pointer, std::size_t n) noexcept
+	{
+#if defined(__linux__)
+		if(const auto bytes = mapped_size(n))
+		{
+			munmap(pointer, bytes);
+			return;
+		}
+#endif
+
+		std::allocator<T>{}.deallocate(pointer, n);
+	}
+
+	// Grows a block from n to new_n elements without copying it: the mapping is extended where it is
+	// if the address space behind it is free, otherwise its pages are moved (not copied) to the start
+	// of a new aligned mapping with mremap. Blocks that are not mappings of their own, and all blocks
+	// on platforms without mremap, return nullptr and stay as they are. hash_map uses this to grow
+	// tables of trivially copyable elements without a second table.
+	T* reallocate(T* pointer, std::size_t n, std::size_t new_n) noexcept
+	{
+#if defined(__linux__) && defined(MREMAP_MAYMOVE) && defined(MREMAP_FIXED)
+		const auto bytes = mapped_size(n);
+		const auto new_bytes = mapped_size(new_n);
+
+		if(bytes == 0 || new_bytes < bytes) return nullptr;
+		if(new_bytes == bytes) return pointer;
+
+		if(mremap(pointer, bytes, new_bytes, 0) != MAP_FAILED)
+		{
+			advise(pointer, new_bytes);
+			return pointer;
+		}
+
+		void* target = nullptr;
+
+		try
+		{
+			target = map(new_bytes);
+		}
+		catch(const std::bad_alloc&)
+		{
+			return nullptr;
+		}
+
+		// the old pages replace the beginning of the new mapping, the rest of it stays untouched
+		if(mremap(pointer, bytes, bytes, MREMAP_MAYMOVE | MREMAP_FIXED, target) == MAP_FAILED)
+		{
+			munmap(target, new_bytes);
+			return nullptr;
+		}
+
+		advise(target, new_bytes);
+		return static_cast<T*>(target);
+#else
+		(void)pointer;
+		(void)n;
+		(void)new_n;
+		return nullptr;
+#endif
+	}
+
+	template<typename U>
+	bool operator==(const huge_page_allocator<U, Pages>&) const noexcept { return true; }
+
+	template<typename U>
+	bool operator!=(const huge_page_allocator<U, Pages>&) const noexcept { return false; }
+
+private:
+#if defined(__linux__)
+	// size of the mapping for n elements rounded up to whole huge pages, 0 for blocks that are too
+	// small to be worth a mapping of their own
+	static std::size_t mapped_size(std::size_t n) noexcept
+	{
+		if(n > (std::size_t(-1) - huge_pages::page_size) / sizeof(T)) return 0;
+
+		const auto bytes = n * sizeof(T);
+		if(bytes < huge_pages::page_size) return 0;
+
+		return (bytes + huge_pages::page_size - 1) & ~(huge_pages::page_size - 1);
+	}
+
+	static void* map(std::size_t bytes)
+	{
+#if defined(MAP_HUGETLB)
+		if constexpr(std::is_same_v<Pages, huge_pages::reserved>)
+		{
+			if(auto memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0); memory != MAP_FAILED)
+			{
+				return memory;
+			}
+		}
+#endif
+
+		// only huge page aligned ranges can be backed by huge pages, so one extra page is mapped and
+		// the unaligned ends are unmapped again
+		auto mapping = mmap(nullptr, bytes + huge_pages::page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mapping == MAP_FAILED) throw std::bad_alloc{};
+
+		const auto address = reinterpret_cast<std::uintptr_t>(mapping);
+		const auto aligned = (address + huge_pages::page_size - 1) & ~std::uintptr_t(huge_pages::page_size - 1);
+
+		if(aligned != address) munmap(mapping, aligned - address);
+		munmap(reinterpret_cast<void*>(aligned + bytes), address + huge_pages::page_size - aligned);
+
+		auto memory = reinterpret_cast<void*>(aligned);
+		advise(memory, bytes);
+
+		return memory;
+	}
+
+	static void advise(void* memory, std::size_t bytes) noexcept
+	{
+#if defined(MADV_HUGEPAGE)
+		// only a hint, the mapping works with regular pages as well if huge pages are disabled
+		madvise(memory, bytes, MADV_HUGEPAGE);
+#else
+		(void)memory;
+		(void)bytes;
+#endif
+	}
+#endif
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "hash_map.hpp"
+#include <atomic>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// Lock-free hash map for phases in which keys are only ever added, e.g. parallel deduplication or
+// interning. Any number of threads can insert and look up concurrently. The capacity is fixed on
+// construction, and elements never move, so pointers to them stay valid for the map's lifetime.
+//
+// Every slot has an atomic control byte using hash_map's encoding plus a busy state:
+// empty -> busy (claimed by one inserting thread with a compare-and-swap) -> full (the key's tag,
+// published once the element is constructed). Inserts of the same key wait for a busy slot to
+// become full to compare keys; lookups skip busy slots, an element under construction does not
+// exist yet.
+template<
+	typename Key,
+	typename Value,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>>
+class insert_only_hash_map
+{
+public:
+	using key_type = Key;
+	using value_type = Value;
+	using size_type = std::size_t;
+
+	struct key_value_pair
+	{
+		const key_type key;
+		value_type value;
+	};
+
+private:
+	using ctrl_type = hash_map_detail::ctrl_type;
+
+	static constexpr ctrl_type ctrl_busy = -1;
+
+	struct slot_type
+	{
+		std::aligned_storage_t<sizeof(key_value_pair), alignof(key_value_pair)> content;
+
+		key_value_pair& pair() noexcept { return *std::launder(reinterpret_cast<key_value_pair*>(&content)); }
+		const key_value_pair& pair() const noexcept { return *std::launder(reinterpret_cast<const key_value_pair*>(&content)); }
+	};
+
+	size_type slot_count;
+	size_type size_limit;
+	std::unique_ptr<std::atomic<ctrl_type>[]> control;
+	std::unique_ptr<slot_type[]> storage;
+	std::atomic<size_type> count{ 0 };
+	Hash hash{};
+	KeyEqual equal{};
+
+public:
+	// room for expected elements at a load of at most 1/2; inserts throw once 7/8 of all slots are used
+	explicit insert_only_hash_map(size_type expected)
+		: slot_count(hash_map_detail::next_power_of_two(std::max<size_type>(16, 2 * expected))),
+		  size_limit(slot_count - slot_count / 8),
+		  control(new std::atomic<ctrl_type>[slot_count]),
+		  storage(new slot_type[slot_count])
+	{
+		for(size_type index = 0; index < slot_count; ++index)
+		{
+			control[index].store(hash_map_detail::ctrl_empty, std::memory_order_relaxed);
+		}
+	}
+
+	insert_only_hash_map(const insert_only_hash_map&) = delete;
+	insert_only_hash_map& operator=(const insert_only_hash_map&) = delete;
+
+	~insert_only_hash_map()
+	{
+		if constexpr(!std::is_trivially_destructible_v<key_value_pair>)
+		{
+			for(size_type index = 0; index < slot_count; ++index)
+			{
+				if(hash_map_detail::is_full(control[index].load(std::memory_order_acquire))) storage[index].pair().~key_value_pair();
+			}
+		}
+	}
+
+	// mutators (lock-free)
+
+	// inserts key with a value constructed from args unless it exists; returns the element of key
+	// and whether it was inserted. Throws std::length_error once the map is full.
+	template<typename K, typename... Args>
+	std::pair<key_value_pair*, bool> try_emplace(K&& key, Args&&... args)
+	{
+		const auto key_hash = hash_map_detail::hash_key(hash, key);
+		const auto tag = hash_map_detail::tag_of(key_hash);
+		const auto mask = slot_count - 1;
+
+		for(auto index = (key_hash >> 7) & mask, probes = size_type(0); probes < slot_count; index = (index + 1) & mask, ++probes)
+		{
+			auto state = control[index].load(std::memory_order_acquire);
+
+			if(state == hash_map_detail::ctrl_empty)
+			{
+				if(count.load(std::memory_order_relaxed) >= size_limit) throw std::length_error{ "insert_only_hash_map is full" };
+
+				if(control[index].compare_exchange_strong(state, ctrl_busy, std::memory_order_acquire, std::memory_order_acquire))
+				{
+					construct(index, std::forward<K>(key), std::forward<Args>(args)...);
+
+					count.fetch_add(1, std::memory_order_relaxed);
+					control[index].store(tag, std::memory_order_release);
+
+					return { &storage[index].pair(), true };
+				}
+			}
+
+			// another thread claimed the slot, it might be inserting the same key
+			while(state == ctrl_busy)
+			{
+				std::this_thread::yield();
+				state = control[index].load(std::memory_order_acquire);
+			}
+
+			if(state == tag && equal(storage[index].pair().key, key)) return { &storage[index].pair(), false };
+		}
+
+		throw std::length_error{ "insert_only_hash_map is full" };
+	}
+
+	template<typename K, typename V>
+	std::pair<key_value_pair*, bool> insert(K&& key, V&& value) { return try_emplace(std::forward<K>(key), std::forward<V>(value)); }
+
+	// lookup (lock-free)
+
+	// the element of key, nullptr if there is none (yet)
+	key_value_pair* find(const key_type& key) noexcept { return const_cast<key_value_pair*>(std::as_const(*this).find(key)); }
+
+	const key_value_pair* find(const key_type& key) const noexcept
+	{
+		const auto key_hash = hash_map_detail::hash_key(hash, key);
+		const auto tag = hash_map_detail::tag_of(key_hash);
+		const auto mask = slot_count - 1;
+
+		for(auto index = (key_hash >> 7) & mask, probes = size_type(0); probes < slot_count; index = (index + 1) & mask, ++probes)
+		{
+			const auto state = control[index].load(std::memory_order_acquire);
+
+			if(state == hash_map_detail::ctrl_empty) return nullptr;
+			if(state == tag && equal(storage[index].pair().key, key)) return &storage[index].pair();
+		}
+
+		return nullptr;
+	}
+
+	bool contains(const key_type& key) const noexcept { return find(key) != nullptr; }
+
+	// calls fn with every element inserted so far; safe during concurrent inserts, which may or may
+	// not be visited
+	template<typename F>
+	void for_each(F&& fn) const
+	{
+		for(size_type index = 0; index < slot_count; ++index)
+		{
+			if(hash_map_detail::is_full(control[index].load(std::memory_order_acquire))) fn(storage[index].pair());
+		}
+	}
+
+	// queries
+
+	size_type size() const noexcept { return count.load(std::memory_order_relaxed); }
+	bool empty() const noexcept { return size() == 0; }
+	size_type capacity() const noexcept { return slot_count; }
+
+private:
+	template<typename K, typename... Args>
+	void construct(size_type index, K&& key, Args&&... args)
+	{
+		try
+		{
+			new(&storage[index].content) key_value_pair{ key_type(std::forward<K>(key)), value_type(std::forward<Args>(args)...) };
+		}
+		catch(...)
+		{
+			// the slot is never reused: a thread waiting for it may already have moved on to insert
+			// the same key further down the probe sequence
+			control[index].store(hash_map_detail::ctrl_deleted, std::memory_order_release);
+			throw;
+		}
+	}
+};
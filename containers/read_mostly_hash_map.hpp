@@ -0,0 +1,272 @@
+#pragma once
+
+#include "epoch_reclamation.hpp"
+#include "hash_map.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+// Concurrent hash map for read-mostly data: lookups take no lock and write no shared memory apart
+// from the calling thread's own epoch record, so any number of readers scale without bouncing cache
+// lines. Writers are serialized by a mutex.
+//
+// Elements are immutable nodes; the table holds atomic pointers to them. A writer publishes a new
+// or replaced element by storing a pointer into a slot, erases by storing a tombstone, and grows by
+// building a new table and swapping the table pointer. Replaced nodes and old tables are retired to
+// the epoch_domain and freed once no reader can see them anymore.
+template<
+	typename Key,
+	typename Value,
+	typename Hash = std::hash<Key>,
+	typename KeyEqual = std::equal_to<Key>>
+class read_mostly_hash_map
+{
+public:
+	using key_type = Key;
+	using value_type = Value;
+	using size_type = std::size_t;
+
+	struct key_value_pair
+	{
+		const key_type key;
+		const value_type value;
+	};
+
+private:
+	struct node
+	{
+		std::size_t hash;
+		key_value_pair pair;
+	};
+
+	// linearly probed array of node pointers; readers find free slots as nullptr, erased ones as
+	// the tombstone marker
+	struct table
+	{
+		explicit table(size_type slot_count)
+			: capacity(slot_count),
+			  slots(new std::atomic<node*>[slot_count])
+		{
+			for(size_type index = 0; index < capacity; ++index)
+			{
+				slots[index].store(nullptr, std::memory_order_relaxed);
+			}
+		}
+
+		const size_type capacity;
+		const std::unique_ptr<std::atomic<node*>[]> slots;
+	};
+
+	static constexpr size_type min_capacity = 16;
+
+	std::atomic<table*> current;
+	std::atomic<size_type> count{ 0 };
+	size_type tombstones = 0;
+	std::mutex write_lock;
+	Hash hash{};
+	KeyEqual equal{};
+
+public:
+	read_mostly_hash_map()
+		: current(new table(min_capacity)) { }
+
+	read_mostly_hash_map(const read_mostly_hash_map&) = delete;
+	read_mostly_hash_map& operator=(const read_mostly_hash_map&) = delete;
+
+	// no reader may be active anymore
+	~read_mostly_hash_map()
+	{
+		const auto elements = current.load(std::memory_order_relaxed);
+
+		for(size_type index = 0; index < elements->capacity; ++index)
+		{
+			const auto element = elements->slots[index].load(std::memory_order_relaxed);
+			if(element != nullptr && element != tombstone()) delete element;
+		}
+
+		delete elements;
+	}
+
+	// lookup (lock-free)
+
+	std::optional<value_type> find(const key_type& key) const
+	{
+		epoch_domain::guard guard{};
+
+		const auto element = lookup(key);
+		if(element == nullptr) return std::nullopt;
+
+		return element->pair.value;
+	}
+
+	bool contains(const key_type& key) const
+	{
+		epoch_domain::guard guard{};
+		return lookup(key) != nullptr;
+	}
+
+	// calls fn with the value of key, returns whether key was found; the value stays valid (and
+	// unchanged) during the call even if a writer replaces or erases it meanwhile
+	template<typename F>
+	bool visit(const key_type& key, F&& fn) const
+	{
+		epoch_domain::guard guard{};
+
+		const auto element = lookup(key);
+		if(element == nullptr) return false;
+
+		std::forward<F>(fn)(element->pair.value);
+		return true;
+	}
+
+	// mutators (serialized)
+
+	// inserts key or replaces its value, returns whether key was new
+	template<typename K, typename V>
+	bool insert(K&& key, V&& value)
+	{
+		const auto key_hash = hash_map_detail::hash_key(hash, key);
+		std::unique_ptr<node> replacement{ new node{ key_hash, { std::forward<K>(key), std::forward<V>(value) } } };
+
+		std::lock_guard<std::mutex> lock{ write_lock };
+
+		auto elements = current.load(std::memory_order_relaxed);
+		auto [index, existing] = locate(*elements, replacement->pair.key, key_hash);
+
+		if(existing != nullptr)
+		{
+			elements->slots[index].store(replacement.release(), std::memory_order_seq_cst);
+			epoch_domain::instance().retire(existing);
+
+			return false;
+		}
+
+		if(count.load(std::memory_order_relaxed) + tombstones + 1 > elements->capacity / 2)
+		{
+			elements = rebuild(count.load(std::memory_order_relaxed) + 1);
+			index = locate(*elements, replacement->pair.key, key_hash).first;
+		}
+
+		if(elements->slots[index].load(std::memory_order_relaxed) == tombstone()) --tombstones;
+
+		elements->slots[index].store(replacement.release(), std::memory_order_seq_cst);
+		count.fetch_add(1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	// returns whether key was erased
+	bool erase(const key_type& key)
+	{
+		std::lock_guard<std::mutex> lock{ write_lock };
+
+		const auto elements = current.load(std::memory_order_relaxed);
+		const auto [index, existing] = locate(*elements, key, hash_map_detail::hash_key(hash, key));
+
+		if(existing == nullptr) return false;
+
+		elements->slots[index].store(tombstone(), std::memory_order_seq_cst);
+		epoch_domain::instance().retire(existing);
+
+		count.fetch_sub(1, std::memory_order_relaxed);
+		++tombstones;
+
+		return true;
+	}
+
+	// makes room for n elements without growing again
+	void reserve(size_type n)
+	{
+		std::lock_guard<std::mutex> lock{ write_lock };
+
+		if(capacity_for(n) > current.load(std::memory_order_relaxed)->capacity) rebuild(n);
+	}
+
+	// queries
+
+	size_type size() const noexcept { return count.load(std::memory_order_relaxed); }
+	bool empty() const noexcept { return size() == 0; }
+
+private:
+	// address that no node can have, never dereferenced
+	static inline char tombstone_marker = 0;
+
+	static node* tombstone() noexcept { return reinterpret_cast<node*>(&tombstone_marker); }
+
+	static size_type capacity_for(size_type elements)
+	{
+		return hash_map_detail::next_power_of_two(std::max(min_capacity, 2 * elements + 1));
+	}
+
+	// loads are sequentially consistent so that they are ordered after the epoch announcement of
+	// the read section (which costs nothing extra on x86)
+	const node* lookup(const key_type& key) const
+	{
+		const auto elements = current.load(std::memory_order_seq_cst);
+		const auto key_hash = hash_map_detail::hash_key(hash, key);
+		const auto mask = elements->capacity - 1;
+
+		for(auto index = key_hash & mask, probes = size_type(0); probes < elements->capacity; index = (index + 1) & mask, ++probes)
+		{
+			const auto element = elements->slots[index].load(std::memory_order_seq_cst);
+
+			if(element == nullptr) return nullptr;
+			if(element != tombstone() && element->hash == key_hash && equal(element->pair.key, key)) return element;
+		}
+
+		return nullptr;
+	}
+
+	// slot of key and its node if present, otherwise the first free slot (empty or tombstone) of its
+	// probe sequence; writers only
+	std::pair<size_type, node*> locate(const table& elements, const key_type& key, std::size_t key_hash) const
+	{
+		const auto mask = elements.capacity - 1;
+		auto free = elements.capacity;
+
+		for(auto index = key_hash & mask, probes = size_type(0); probes < elements.capacity; index = (index + 1) & mask, ++probes)
+		{
+			const auto element = elements.slots[index].load(std::memory_order_relaxed);
+
+			if(element == nullptr) return { free == elements.capacity ? index : free, nullptr };
+
+			if(element == tombstone())
+			{
+				if(free == elements.capacity) free = index;
+			}
+			else if(element->hash == key_hash && equal(element->pair.key, key))
+			{
+				return { index, element };
+			}
+		}
+
+		return { free, nullptr };
+	}
+
+	// publishes a new table for elements (dropping all tombstones) and retires the current one;
+	// the nodes themselves are shared by both tables
+	table* rebuild(size_type elements)
+	{
+		const auto previous = current.load(std::memory_order_relaxed);
+		const auto next = new table(capacity_for(elements));
+		const auto mask = next->capacity - 1;
+
+		for(size_type index = 0; index < previous->capacity; ++index)
+		{
+			const auto element = previous->slots[index].load(std::memory_order_relaxed);
+			if(element == nullptr || element == tombstone()) continue;
+
+			auto target = element->hash & mask;
+			while(next->slots[target].load(std::memory_order_relaxed) != nullptr) target = (target + 1) & mask;
+
+			next->slots[target].store(element, std::memory_order_relaxed);
+		}
+
+		current.store(next, std::memory_order_seq_cst);
+		tombstones = 0;
+
+		epoch_domain::instance().retire(previous);
+		return next;
+	}
+};
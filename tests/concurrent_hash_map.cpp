@@ -0,0 +1,139 @@
+#include "catch.hpp"
+#include "concurrent_hash_map.hpp"
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	int hash_calls = 0;
+
+	struct counting_hash
+	{
+		std::size_t operator()(int key) const noexcept
+		{
+			++hash_calls;
+			return std::hash<int>{}(key);
+		}
+	};
+}
+
+TEST_CASE("concurrent hash map", "[concurrent_hash_map]")
+{
+	SECTION("shard counts are powers of two")
+	{
+		REQUIRE(concurrent_hash_map<int, int>{ 1 }.shard_count() == 1u);
+		REQUIRE(concurrent_hash_map<int, int>{ 5 }.shard_count() == 8u);
+		REQUIRE(concurrent_hash_map<int, int>{}.shard_count() >= 4u);
+	}
+
+	SECTION("single threaded use behaves like a hash map")
+	{
+		concurrent_hash_map<std::string, int> map{ 4 };
+
+		REQUIRE(map.insert(std::string{ "one" }, 1));
+		REQUIRE(!map.insert(std::string{ "one" }, 10));
+		REQUIRE(map.try_emplace(std::string{ "two" }, 2));
+		REQUIRE(!map.try_emplace(std::string{ "two" }, 20));
+
+		REQUIRE(map.find("one") == 10);
+		REQUIRE(map.find("two") == 2);
+		REQUIRE(!map.find("three"));
+		REQUIRE(map.size() == 2u);
+
+		REQUIRE(map.visit("two", [](int& value) { value *= 2; }));
+		REQUIRE(!map.visit("three", [](int&) {}));
+		REQUIRE(map.find("two") == 4);
+
+		REQUIRE(map.erase("one"));
+		REQUIRE(!map.erase("one"));
+		REQUIRE(!map.contains("one"));
+
+		map.clear();
+		REQUIRE(map.empty());
+	}
+
+	SECTION("every operation hashes its key once")
+	{
+		concurrent_hash_map<int, int, counting_hash> map{ 4 };
+		map.reserve(100);
+
+		hash_calls = 0;
+
+		REQUIRE(map.insert(1, 1));
+		REQUIRE(map.try_emplace(2, 2));
+		REQUIRE(map.upsert(3, [](int& value) { ++value; }, 3));
+		REQUIRE(map.find(1) == 1);
+		REQUIRE(map.contains(2));
+		REQUIRE(map.visit(3, [](int& value) { ++value; }));
+		REQUIRE(map.erase(3));
+
+		REQUIRE(hash_calls == 7);
+	}
+
+	SECTION("concurrent inserts and lookups")
+	{
+		constexpr auto threads = 8;
+		constexpr auto per_thread = 20000;
+
+		concurrent_hash_map<int, int> map{ 16 };
+		std::vector<std::thread> workers{};
+
+		for(auto t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&map, t] {
+				for(auto i = t * per_thread; i < (t + 1) * per_thread; ++i)
+				{
+					map.insert(i, i);
+
+					// reads of keys another thread may be inserting right now
+					map.contains((i * 7) % (threads * per_thread));
+				}
+			});
+		}
+
+		for(auto& worker : workers)
+		{
+			worker.join();
+		}
+
+		REQUIRE(map.size() == std::size_t(threads * per_thread));
+
+		std::size_t visited = 0;
+		map.for_each([&](const auto& element) {
+			REQUIRE(element.key == element.value);
+			++visited;
+		});
+
+		REQUIRE(visited == std::size_t(threads * per_thread));
+	}
+
+	SECTION("concurrent upserts do not lose updates")
+	{
+		constexpr auto threads = 8;
+		constexpr auto increments = 10000;
+
+		concurrent_hash_map<int, int> map{ 4 };
+		std::vector<std::thread> workers{};
+
+		for(auto t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&map] {
+				for(auto i = 0; i < increments; ++i)
+				{
+					map.upsert(i % 100, [](int& count) { ++count; }, 0);
+				}
+			});
+		}
+
+		for(auto& worker : workers)
+		{
+			worker.join();
+		}
+
+		for(auto key = 0; key < 100; ++key)
+		{
+			REQUIRE(map.find(key) == threads * increments / 100);
+		}
+	}
+}
@@ -2,6 +2,16 @@
 #include "catch.hpp"
 #include "hash_map.hpp"
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory_resource>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 using hash_map_impl = hash_map<int, int, std::hash<int>>;
 
@@ -137,6 +147,18 @@ TEST_CASE("An empty hash map", "[hash_map]")
 		REQUIRE(iter_two->value == value_two);
 	}
 
+	SECTION("capacity stays a power of two while growing")
+	{
+		for(auto i = 0; i < 1000; ++i)
+		{
+			map.insert(i, i);
+			CHECK((map.capacity() & (map.capacity() - 1)) == 0u);
+		}
+
+		REQUIRE(map.size() == 1000u);
+		REQUIRE(map.find(999)->value == 999);
+	}
+
 	SECTION("hash map grows storage if load grows too large")
 	{
 		auto max_load = int( map.max_load_factor() * map.capacity() );
@@ -227,6 +249,19 @@ TEST_CASE("Non empty hash map", "[hash_map]")
 		}
 	}
 
+	SECTION("insert_or_assign updates existing keys and inserts new ones")
+	{
+		auto [updated, update_inserted] = map.insert_or_assign(3, 40);
+		REQUIRE(!update_inserted);
+		REQUIRE(updated->value == 40);
+		REQUIRE(map.size() == 6u);
+
+		auto [added, add_inserted] = map.insert_or_assign(6, 7);
+		REQUIRE(add_inserted);
+		REQUIRE(added->value == 7);
+		REQUIRE(map.size() == 7u);
+	}
+
 	SECTION("Delete key, and reinsert the same key with the value")
 	{
 		map.erase(5);
@@ -235,12 +270,19 @@ TEST_CASE("Non empty hash map", "[hash_map]")
 }
 
 static int counter = 0;
+static int copies_until_throw = -1; // copy constructions left before one throws, negative for never
 
 struct my_class
 {
 	my_class() { ++counter; }
-	my_class(my_class&&) = default;
-	my_class(const my_class&) = default;
+	my_class(my_class&&) { ++counter; }
+
+	my_class(const my_class&)
+	{
+		if(copies_until_throw >= 0 && copies_until_throw-- == 0) throw std::runtime_error{ "copy failed" };
+		++counter;
+	}
+
 	~my_class() { --counter; }
 
 	my_class& operator=(const my_class&) = default;
@@ -262,4 +304,1566 @@ TEST_CASE("generic hash map")
 
 		REQUIRE(counter == 0);
 	}
+
+	SECTION("erasing an element destroys it")
+	{
+		hash_map<int, my_class> map{};
+
+		map.emplace(1);
+		map.emplace(2);
+		map.erase(1);
+
+		REQUIRE(counter == 1);
+	}
+
+	SECTION("growing the map keeps every element alive exactly once")
+	{
+		{
+			hash_map<int, my_class> map{};
+
+			for(auto i = 0; i < 100; ++i)
+			{
+				map.emplace(i);
+			}
+
+			REQUIRE(counter == 100);
+		}
+
+		REQUIRE(counter == 0);
+	}
+
+	SECTION("emplacing an existing key replaces the value without leaking it")
+	{
+		{
+			hash_map<int, my_class> map{};
+
+			map.emplace(1);
+			map.emplace(1);
+			REQUIRE(counter == 1);
+		}
+
+		REQUIRE(counter == 0);
+	}
+
+	SECTION("try_emplace does not construct a value for an existing key")
+	{
+		hash_map<int, my_class> map{};
+
+		auto [first, first_inserted] = map.try_emplace(1);
+		REQUIRE(first_inserted);
+		REQUIRE(counter == 1);
+
+		auto [second, second_inserted] = map.try_emplace(1);
+		REQUIRE(!second_inserted);
+		REQUIRE(first == second);
+		REQUIRE(counter == 1);
+	}
+
+	SECTION("copying and moving a map")
+	{
+		{
+			hash_map<int, my_class> map{};
+			map.emplace(1);
+			map.emplace(2);
+
+			auto copy = map;
+			REQUIRE(copy.size() == 2u);
+			REQUIRE(copy.find(2) != copy.end());
+			REQUIRE(counter == 4);
+
+			auto moved = std::move(copy);
+			REQUIRE(moved.size() == 2u);
+			REQUIRE(moved.find(1) != moved.end());
+			REQUIRE(counter == 4);
+		}
+
+		REQUIRE(counter == 0);
+	}
+
+	SECTION("moving a map leaves it empty without a table")
+	{
+		static_assert(std::is_nothrow_move_constructible_v<hash_map<int, my_class>>, "vectors of maps move them on reallocation");
+
+		hash_map<int, my_class> map{};
+		map.emplace(1);
+
+		auto moved = std::move(map);
+		REQUIRE(moved.size() == 1u);
+		REQUIRE(counter == 1);
+
+		REQUIRE(map.empty());
+		REQUIRE(map.capacity() == 0u);
+		REQUIRE(map.load_factor() == 0.0);
+		REQUIRE(map.begin() == map.end());
+		REQUIRE(map.find(1) == map.end());
+		REQUIRE_FALSE(map.contains(1));
+		REQUIRE(map.stats().longest_cluster == 0u);
+
+		const std::vector<int> keys{ 1, 2 };
+		std::vector<bool> found{};
+		map.contains_many(keys.begin(), keys.end(), std::back_inserter(found));
+		REQUIRE(found == std::vector<bool>{ false, false });
+
+		map.emplace(2);
+		REQUIRE(map.size() == 1u);
+		REQUIRE(map.contains(2));
+		REQUIRE(counter == 2);
+	}
+
+	SECTION("a vector of maps moves them when it reallocates")
+	{
+		std::vector<hash_map<int, my_class>> maps(1);
+		maps[0].emplace(1);
+
+		copies_until_throw = 0;
+
+		for(auto i = 0; i < 20; ++i)
+		{
+			maps.emplace_back();
+		}
+
+		copies_until_throw = -1;
+
+		REQUIRE(maps[0].contains(1));
+		REQUIRE(counter == 1);
+	}
+
+	SECTION("a copy that throws destroys the elements copied so far")
+	{
+		{
+			hash_map<int, my_class> map{};
+
+			for(auto i = 0; i < 10; ++i)
+			{
+				map.emplace(i);
+			}
+
+			copies_until_throw = 5;
+			REQUIRE_THROWS_AS((hash_map<int, my_class>{ map }), std::runtime_error);
+			copies_until_throw = -1;
+
+			REQUIRE(counter == 10);
+		}
+
+		REQUIRE(counter == 0);
+	}
+}
+
+struct colliding_hash
+{
+	std::size_t operator()(int) const noexcept { return 0; }
+};
+
+TEST_CASE("hash map with colliding hashes", "[hash_map]")
+{
+	hash_map<int, int, colliding_hash> map{};
+
+	for(auto i = 0; i < 100; ++i)
+	{
+		map.insert(i, i * 2);
+	}
+
+	SECTION("all elements can be found across probed groups")
+	{
+		REQUIRE(map.size() == 100u);
+
+		for(auto i = 0; i < 100; ++i)
+		{
+			auto iter = map.find(i);
+			REQUIRE(iter != map.end());
+			REQUIRE(iter->value == i * 2);
+		}
+
+		REQUIRE(map.find(100) == map.end());
+	}
+
+	SECTION("erasing elements keeps the rest of the probe sequence reachable")
+	{
+		for(auto i = 0; i < 100; i += 2)
+		{
+			map.erase(i);
+		}
+
+		for(auto i = 0; i < 100; ++i)
+		{
+			REQUIRE((map.find(i) != map.end()) == (i % 2 == 1));
+		}
+
+		map.insert(0, 7);
+		REQUIRE(map.find(0)->value == 7);
+		REQUIRE(map.size() == 51u);
+	}
+}
+
+struct clustering_hash
+{
+	std::size_t operator()(int key) const noexcept { return std::size_t(key % 61); }
+};
+
+template<typename Map>
+void check_against_reference(Map& map)
+{
+	std::unordered_map<int, int> reference{};
+	std::mt19937 random{ 42 };
+	std::uniform_int_distribution<int> keys{ 0, 499 };
+
+	for(auto step = 0; step < 20000; ++step)
+	{
+		const auto key = keys(random);
+
+		if(random() % 3 == 0)
+		{
+			if(reference.erase(key) != 0) map.erase(key);
+		}
+		else
+		{
+			map.insert(key, step);
+			reference[key] = step;
+		}
+
+		REQUIRE(map.size() == reference.size());
+	}
+
+	for(auto key = 0; key < 500; ++key)
+	{
+		auto match = map.find(key);
+		auto expected = reference.find(key);
+
+		REQUIRE((match != map.end()) == (expected != reference.end()));
+		if(expected != reference.end()) REQUIRE(match->value == expected->second);
+	}
+
+	REQUIRE(std::distance(map.begin(), map.end()) == std::ptrdiff_t(reference.size()));
+	REQUIRE(map.tombstone_count() < map.capacity());
+}
+
+TEST_CASE("hash map probing modes under churn", "[hash_map]")
+{
+	SECTION("tombstone probing")
+	{
+		hash_map<int, int, clustering_hash, std::equal_to<int>, hash_map_probing::tombstones> map{};
+		check_against_reference(map);
+	}
+
+	SECTION("robin hood probing")
+	{
+		hash_map<int, int, clustering_hash, std::equal_to<int>, hash_map_probing::robin_hood> map{};
+		check_against_reference(map);
+	}
+
+	SECTION("robin hood probing with a single colliding hash")
+	{
+		hash_map<int, int, colliding_hash, std::equal_to<int>, hash_map_probing::robin_hood> map{};
+		check_against_reference(map);
+	}
+}
+
+TEST_CASE("hash map tombstones", "[hash_map]")
+{
+	hash_map<int, int, colliding_hash> map{};
+
+	for(auto i = 0; i < 200; ++i)
+	{
+		map.insert(i, i);
+	}
+
+	for(auto i = 0; i < 200; i += 3)
+	{
+		map.erase(i);
+	}
+
+	SECTION("erasing from full groups leaves tombstones")
+	{
+		REQUIRE(map.tombstone_count() > 0u);
+	}
+
+	SECTION("purge clears tombstones at the same capacity")
+	{
+		const auto cap = map.capacity();
+		const auto size = map.size();
+
+		map.purge();
+
+		REQUIRE(map.tombstone_count() == 0u);
+		REQUIRE(map.capacity() == cap);
+		REQUIRE(map.size() == size);
+
+		for(auto i = 0; i < 200; ++i)
+		{
+			REQUIRE((map.find(i) != map.end()) == (i % 3 != 0));
+		}
+	}
+
+	SECTION("robin hood probing never leaves tombstones")
+	{
+		hash_map<int, int, colliding_hash, std::equal_to<int>, hash_map_probing::robin_hood> robin_hood_map{};
+
+		for(auto i = 0; i < 200; ++i)
+		{
+			robin_hood_map.insert(i, i);
+		}
+
+		for(auto i = 0; i < 200; i += 3)
+		{
+			robin_hood_map.erase(i);
+		}
+
+		REQUIRE(robin_hood_map.tombstone_count() == 0u);
+	}
+}
+
+struct dense_growth_policy : hash_map_growth_policy
+{
+	dense_growth_policy() noexcept
+	{
+		max_load_factor = 0.875;
+		growth_factor = 4.0;
+		min_capacity = 64;
+	}
+};
+
+TEST_CASE("hash map growth policy", "[hash_map]")
+{
+	SECTION("a custom policy type sets the defaults")
+	{
+		hash_map<int, int, std::hash<int>, std::equal_to<int>, hash_map_probing::tombstones, dense_growth_policy> map{};
+
+		REQUIRE(map.capacity() == 64u);
+		REQUIRE(map.max_load_factor() == Approx(0.875));
+
+		for(auto i = 0; i < 56; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		REQUIRE(map.capacity() == 64u);
+
+		map.insert(56, 56);
+		REQUIRE(map.capacity() == 256u);
+	}
+
+	SECTION("the max load factor can be changed at runtime")
+	{
+		hash_map_impl map{};
+
+		for(auto i = 0; i < 100; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		map.max_load_factor(0.25);
+		REQUIRE(map.load_factor() <= 0.25);
+
+		map.max_load_factor(0.875);
+		REQUIRE(map.max_load_factor() == Approx(0.875));
+
+		for(auto i = 0; i < 100; ++i)
+		{
+			REQUIRE(map.find(i)->value == i);
+		}
+	}
+
+	SECTION("erasing shrinks the table below the shrink load factor")
+	{
+		auto growth = hash_map_growth_policy{};
+		growth.shrink_load_factor = 0.125;
+
+		hash_map_impl map{ growth };
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		const auto cap = map.capacity();
+
+		for(auto i = 0; i < 990; ++i)
+		{
+			map.erase(i);
+		}
+
+		REQUIRE(map.capacity() < cap);
+		REQUIRE(map.capacity() >= growth.min_capacity);
+		REQUIRE(map.find(995)->value == 995);
+	}
+
+	SECTION("invalid policies are rejected")
+	{
+		hash_map_impl map{};
+
+		REQUIRE_THROWS_AS(map.max_load_factor(1.0), std::invalid_argument);
+		REQUIRE_THROWS_AS(map.max_load_factor(0.0), std::invalid_argument);
+
+		auto growth = hash_map_growth_policy{};
+		growth.growth_factor = 1.0;
+		REQUIRE_THROWS_AS(hash_map_impl{ growth }, std::invalid_argument);
+	}
+}
+
+TEST_CASE("hash map presizing", "[hash_map]")
+{
+	SECTION("reserve makes room for the requested number of elements")
+	{
+		hash_map_impl map{};
+		map.reserve(1000);
+
+		const auto cap = map.capacity();
+		REQUIRE(map.max_load_factor() * cap >= 1000.0);
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		REQUIRE(map.capacity() == cap);
+	}
+
+	SECTION("a batch that only updates existing keys does not grow the table")
+	{
+		hash_map_impl map{};
+		std::vector<std::pair<int, int>> updates{};
+
+		for(auto i = 0; i < 100000; ++i)
+		{
+			map.insert(i, i);
+			updates.emplace_back(i, -i);
+		}
+
+		const auto cap = map.capacity();
+		map.insert(updates.begin(), updates.end());
+
+		REQUIRE(map.size() == 100000u);
+		REQUIRE(map.capacity() == cap);
+		REQUIRE(map.find(99999)->value == -99999);
+	}
+
+	SECTION("sizes beyond max_size() throw instead of overflowing")
+	{
+		hash_map_impl map{};
+		map.insert(1, 1);
+
+		REQUIRE(map.max_size() > 0u);
+		REQUIRE_THROWS_AS(map.reserve(map.max_size() + 1), std::length_error);
+		REQUIRE_THROWS_AS(map.reserve(SIZE_MAX / 2), std::length_error);
+		REQUIRE_THROWS_AS(map.reserve((std::size_t(1) << 63) + 1), std::length_error);
+		REQUIRE_THROWS_AS(map.reserve(SIZE_MAX), std::length_error);
+		REQUIRE_THROWS_AS(map.rehash(SIZE_MAX), std::length_error);
+		REQUIRE_THROWS_AS(hash_map_impl(SIZE_MAX), std::length_error);
+		REQUIRE_THROWS_AS(hash_map_detail::next_power_of_two(SIZE_MAX), std::length_error);
+
+		REQUIRE(map.size() == 1u);
+		REQUIRE(map.find(1)->value == 1);
+	}
+
+	SECTION("rehash never shrinks below the current size")
+	{
+		hash_map_impl map{};
+
+		for(auto i = 0; i < 100; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		map.rehash(1024);
+		REQUIRE(map.capacity() == 1024u);
+
+		map.rehash(0);
+		REQUIRE(map.capacity() < 1024u);
+		REQUIRE(map.load_factor() <= map.max_load_factor());
+
+		for(auto i = 0; i < 100; ++i)
+		{
+			REQUIRE(map.find(i)->value == i);
+		}
+	}
+
+	SECTION("constructing from a range sizes the table once")
+	{
+		std::vector<std::pair<int, int>> elements{};
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			elements.emplace_back(i, i * 2);
+		}
+
+		hash_map_impl map(elements.begin(), elements.end());
+
+		REQUIRE(map.size() == 1000u);
+		REQUIRE(map.capacity() == hash_map_impl(1000).capacity());
+		REQUIRE(map.find(999)->value == 1998);
+	}
+
+	SECTION("batched inserts match inserting one element at a time")
+	{
+		std::mt19937 random{ 7 };
+		std::vector<std::pair<int, int>> elements{};
+
+		for(auto i = 0; i < 5000; ++i)
+		{
+			elements.emplace_back(int(random() % 3000), i);
+		}
+
+		hash_map_impl batched{};
+		hash_map_impl single{};
+
+		batched.insert_batch(elements.begin(), elements.end());
+
+		for(const auto& element : elements)
+		{
+			single.insert(element.first, element.second);
+		}
+
+		REQUIRE(batched.size() == single.size());
+
+		for(const auto& element : single)
+		{
+			REQUIRE(batched.find(element.key)->value == element.value);
+		}
+	}
+
+	SECTION("constructing from an initializer list keeps the last value of a key")
+	{
+		hash_map_impl map{ { 1, 10 }, { 2, 20 }, { 1, 30 } };
+
+		REQUIRE(map.size() == 2u);
+		REQUIRE(map.find(1)->value == 30);
+		REQUIRE(map.find(2)->value == 20);
+	}
+}
+
+TEST_CASE("hash map batched lookups", "[hash_map]")
+{
+	hash_map_impl map{};
+
+	for(auto i = 0; i < 1000; i += 2)
+	{
+		map.insert(i, i * 3);
+	}
+
+	std::vector<int> keys{};
+
+	for(auto i = 0; i < 1000; ++i)
+	{
+		keys.push_back(i);
+	}
+
+	SECTION("find_many writes one iterator per key")
+	{
+		std::vector<hash_map_impl::iterator> found{};
+		map.find_many(keys.begin(), keys.end(), std::back_inserter(found));
+
+		REQUIRE(found.size() == keys.size());
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			if(i % 2 == 0)
+			{
+				REQUIRE(found[i]->value == i * 3);
+			}
+			else
+			{
+				REQUIRE(found[i] == map.end());
+			}
+		}
+	}
+
+	SECTION("contains_many writes one flag per key")
+	{
+		bool hits[1000];
+		const auto& cmap = map;
+
+		REQUIRE(cmap.contains_many(keys.begin(), keys.end(), hits) == hits + 1000);
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			REQUIRE(hits[i] == (i % 2 == 0));
+		}
+	}
+}
+
+// makes every allocation that does not go through a map's allocator fail
+struct null_default_resource
+{
+	std::pmr::memory_resource* previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+	~null_default_resource() { std::pmr::set_default_resource(previous); }
+};
+
+// counts the allocations that reach it and forwards them to the default new/delete resource
+struct counting_resource : std::pmr::memory_resource
+{
+	std::size_t allocations = 0;
+
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override
+	{
+		++allocations;
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override
+	{
+		std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+TEST_CASE("hash map with a polymorphic allocator", "[hash_map]")
+{
+	std::pmr::monotonic_buffer_resource arena{};
+	std::pmr::unsynchronized_pool_resource other_arena{};
+	null_default_resource guard{};
+
+	SECTION("all memory comes from the memory resource")
+	{
+		pmr::hash_map<std::string, int, std::hash<std::string>, std::equal_to<std::string>, hash_map_probing::robin_hood> map{ &arena };
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			map.insert(std::to_string(i), i);
+		}
+
+		map.rehash(4096);
+
+		REQUIRE(map.get_allocator().resource() == &arena);
+		REQUIRE(map.find("999")->value == 999);
+	}
+
+	SECTION("copies and moves keep the allocator of their target")
+	{
+		pmr::hash_map<int, int> map{ &arena };
+
+		for(auto i = 0; i < 100; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		pmr::hash_map<int, int> copy{ map, &other_arena };
+		REQUIRE(copy.get_allocator().resource() == &other_arena);
+
+		pmr::hash_map<int, int> moved{ &other_arena };
+		moved = std::move(map);
+
+		REQUIRE(moved.get_allocator().resource() == &other_arena);
+		REQUIRE(map.get_allocator().resource() == &arena);
+		REQUIRE(moved.size() == 100u);
+		REQUIRE(map.empty());
+
+		copy = moved;
+		REQUIRE(copy.get_allocator().resource() == &other_arena);
+
+		for(auto i = 0; i < 100; ++i)
+		{
+			REQUIRE(copy.find(i)->value == i);
+			REQUIRE(moved.find(i)->value == i);
+		}
+	}
+
+	SECTION("moving into a map with an equal allocator takes over the table")
+	{
+		static_assert(std::is_nothrow_move_assignable_v<hash_map<int, my_class>>, "maps with std::allocator never allocate on move assignment");
+
+		counting_resource counter{};
+		pmr::hash_map<std::string, int> map{ &counter };
+		pmr::hash_map<std::string, int> moved{ &counter };
+
+		for(auto i = 0; i < 100; ++i)
+		{
+			map.insert(std::to_string(i), i);
+			moved.insert(std::to_string(-i), i);
+		}
+
+		const auto allocations = counter.allocations;
+		moved = std::move(map);
+
+		REQUIRE(counter.allocations == allocations);
+		REQUIRE(moved.size() == 100u);
+		REQUIRE(map.empty());
+		REQUIRE(map.capacity() == 0u);
+		REQUIRE_FALSE(moved.contains("-1"));
+
+		for(auto i = 0; i < 100; ++i)
+		{
+			REQUIRE(moved.find(std::to_string(i))->value == i);
+		}
+
+		map.insert("0", 0);
+		REQUIRE(map.find("0")->value == 0);
+	}
+
+	SECTION("robin hood inserts into a reserved table do not allocate")
+	{
+		counting_resource counter{};
+		pmr::hash_map<int, int, clustering_hash, std::equal_to<int>, hash_map_probing::robin_hood> map{ &counter };
+		map.reserve(2000);
+
+		const auto allocations = counter.allocations;
+
+		for(auto i = 0; i < 2000; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		REQUIRE(counter.allocations == allocations);
+
+		for(auto i = 0; i < 2000; ++i)
+		{
+			REQUIRE(map.find(i)->value == i);
+		}
+	}
+}
+
+// allocator with reallocate() on top of std::realloc, counting the blocks allocated and resized
+static std::size_t allocated_blocks = 0;
+static std::size_t resized_blocks = 0;
+
+template<typename T>
+struct resizing_allocator
+{
+	using value_type = T;
+
+	resizing_allocator() = default;
+
+	template<typename U>
+	resizing_allocator(const resizing_allocator<U>&) noexcept {}
+
+	T* allocate(std::size_t n)
+	{
+		++allocated_blocks;
+		if(auto block = std::malloc(n * sizeof(T))) return static_cast<T*>(block);
+		throw std::bad_alloc{};
+	}
+
+	void deallocate(T* pointer, std::size_t) noexcept { std::free(pointer); }
+
+	T* reallocate(T* pointer, std::size_t, std::size_t new_n) noexcept
+	{
+		++resized_blocks;
+		return static_cast<T*>(std::realloc(pointer, new_n * sizeof(T)));
+	}
+
+	template<typename U>
+	bool operator==(const resizing_allocator<U>&) const noexcept { return true; }
+
+	template<typename U>
+	bool operator!=(const resizing_allocator<U>&) const noexcept { return false; }
+};
+
+TEST_CASE("hash map with an allocator that resizes blocks", "[hash_map]")
+{
+	allocated_blocks = 0;
+	resized_blocks = 0;
+
+	SECTION("tables grow without a second slot array")
+	{
+		hash_map<int, int, std::hash<int>, std::equal_to<int>, hash_map_probing::tombstones, hash_map_growth_policy, resizing_allocator<std::pair<const int, int>>> map{};
+
+		for(auto i = 0; i < 100000; ++i)
+		{
+			map.insert(i, -i);
+		}
+
+		// the first slot and control arrays, then one new control array per growth
+		REQUIRE(resized_blocks > 10u);
+		REQUIRE(allocated_blocks == 2 + resized_blocks);
+
+		for(auto i = 0; i < 100000; ++i)
+		{
+			REQUIRE(map.find(i)->value == -i);
+		}
+
+		REQUIRE(std::distance(map.begin(), map.end()) == 100000);
+	}
+
+	SECTION("elements and tombstones are placed again when growing in place")
+	{
+		hash_map<int, int, clustering_hash, std::equal_to<int>, hash_map_probing::tombstones, hash_map_growth_policy, resizing_allocator<std::pair<const int, int>>> map{};
+		check_against_reference(map);
+
+		REQUIRE(resized_blocks > 0u);
+	}
+
+	SECTION("robin hood tables and elements that are not trivially copyable are rehashed as before")
+	{
+		hash_map<int, int, std::hash<int>, std::equal_to<int>, hash_map_probing::robin_hood, hash_map_growth_policy, resizing_allocator<std::pair<const int, int>>> robin_hood_map{};
+		hash_map<std::string, int, std::hash<std::string>, std::equal_to<std::string>, hash_map_probing::tombstones, hash_map_growth_policy, resizing_allocator<std::pair<const std::string, int>>> string_map{};
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			robin_hood_map.insert(i, i);
+			string_map.insert(std::to_string(i), i);
+		}
+
+		REQUIRE(resized_blocks == 0u);
+		REQUIRE(robin_hood_map.find(999)->value == 999);
+		REQUIRE(string_map.find("999")->value == 999);
+	}
+}
+
+struct incremental_growth_policy : hash_map_growth_policy
+{
+	incremental_growth_policy() noexcept { incremental_step = 4; }
+};
+
+TEST_CASE("hash map with incremental growth", "[hash_map]")
+{
+	using incremental_map = hash_map<int, int, std::hash<int>, std::equal_to<int>, hash_map_probing::tombstones, incremental_growth_policy>;
+
+	SECTION("growing keeps the previous table until all elements are migrated")
+	{
+		incremental_map map{};
+
+		const auto cap = map.capacity();
+		auto inserted = 0;
+
+		while(map.capacity() == cap)
+		{
+			REQUIRE_FALSE(map.rehashing());
+			map.insert(inserted, inserted);
+			++inserted;
+		}
+
+		REQUIRE(map.rehashing());
+
+		for(auto i = 0; i < inserted; ++i)
+		{
+			REQUIRE(map.contains(i));
+		}
+
+		REQUIRE(std::distance(map.begin(), map.end()) == inserted);
+
+		map.erase(0);
+		REQUIRE(map.size() == std::size_t(inserted - 1));
+		REQUIRE_FALSE(map.contains(0));
+
+		for(auto i = 1; map.rehashing(); ++i)
+		{
+			REQUIRE(map.find(i)->value == i);
+		}
+
+		REQUIRE(std::distance(map.begin(), map.end()) == inserted - 1);
+	}
+
+	SECTION("batched lookups see both tables")
+	{
+		incremental_map map{};
+		std::vector<int> keys{};
+
+		while(!map.rehashing())
+		{
+			keys.push_back(int(keys.size()));
+			map.insert(keys.back(), keys.back());
+		}
+
+		keys.push_back(-1);
+
+		std::vector<incremental_map::const_iterator> found{};
+		static_cast<const incremental_map&>(map).find_many(keys.begin(), keys.end(), std::back_inserter(found));
+
+		REQUIRE(map.rehashing());
+		REQUIRE(found.back() == map.cend());
+
+		for(std::size_t i = 0; i + 1 < keys.size(); ++i)
+		{
+			REQUIRE(found[i]->key == keys[i]);
+		}
+	}
+
+	SECTION("copies take over the elements of the previous table")
+	{
+		incremental_map map{};
+
+		auto inserted = 0;
+
+		while(!map.rehashing())
+		{
+			map.insert(inserted, inserted);
+			++inserted;
+		}
+
+		const auto copy = map;
+
+		REQUIRE_FALSE(copy.rehashing());
+		REQUIRE(copy.size() == std::size_t(inserted));
+
+		for(auto i = 0; i < inserted; ++i)
+		{
+			REQUIRE(copy.find(i)->value == i);
+		}
+	}
+
+	SECTION("a new policy finishes the migration")
+	{
+		incremental_map map{};
+
+		auto inserted = 0;
+
+		while(!map.rehashing())
+		{
+			map.insert(inserted, inserted);
+			++inserted;
+		}
+
+		incremental_growth_policy all_at_once{};
+		all_at_once.incremental_step = 0;
+		map.growth_policy(all_at_once);
+
+		REQUIRE_FALSE(map.rehashing());
+		REQUIRE(map.size() == std::size_t(inserted));
+
+		for(auto i = 0; i < inserted; ++i)
+		{
+			REQUIRE(map.find(i)->value == i);
+		}
+
+		REQUIRE(std::distance(map.begin(), map.end()) == inserted);
+	}
+
+	SECTION("tombstone probing")
+	{
+		hash_map<int, int, clustering_hash, std::equal_to<int>, hash_map_probing::tombstones, incremental_growth_policy> map{};
+		check_against_reference(map);
+	}
+
+	SECTION("robin hood probing")
+	{
+		hash_map<int, int, clustering_hash, std::equal_to<int>, hash_map_probing::robin_hood, incremental_growth_policy> map{};
+		check_against_reference(map);
+	}
+}
+
+struct parallel_growth_policy : hash_map_growth_policy
+{
+	parallel_growth_policy() noexcept { rehash_threads = 4; }
+};
+
+// runs the tasks one after another, last one first
+struct reverse_parallel_for
+{
+	std::size_t* calls;
+
+	template<typename Task>
+	void operator()(std::size_t tasks, const Task& task) const
+	{
+		++*calls;
+		for(auto index = tasks; index-- > 0;) task(index);
+	}
+};
+
+TEST_CASE("hash map with parallel rehash", "[hash_map]")
+{
+	SECTION("growth places elements from several threads")
+	{
+		hash_map<int, int, std::hash<int>, std::equal_to<int>, hash_map_probing::tombstones, parallel_growth_policy> map{};
+
+		for(auto i = 0; i < 200000; ++i)
+		{
+			map.insert(i, -i);
+		}
+
+		REQUIRE(map.size() == 200000);
+		REQUIRE(std::distance(map.begin(), map.end()) == 200000);
+
+		for(auto i = 0; i < 200000; ++i)
+		{
+			REQUIRE(map.find(i)->value == -i);
+		}
+
+		REQUIRE_FALSE(map.contains(200000));
+	}
+
+	SECTION("reserve and rehash run on the given parallel_for")
+	{
+		hash_map<std::string, int> map{};
+
+		for(auto i = 0; i < 5000; ++i)
+		{
+			map.insert(std::to_string(i), i);
+		}
+
+		std::size_t calls = 0;
+
+		map.reserve(20000, 8, reverse_parallel_for{ &calls });
+		REQUIRE(calls == 1);
+		REQUIRE(map.capacity() >= 40000);
+
+		map.erase("0");
+		map.rehash(0, 3, reverse_parallel_for{ &calls });
+		REQUIRE(calls == 2);
+
+		REQUIRE(map.size() == 4999);
+		REQUIRE_FALSE(map.contains("0"));
+
+		for(auto i = 1; i < 5000; ++i)
+		{
+			REQUIRE(map.find(std::to_string(i))->value == i);
+		}
+	}
+
+	SECTION("robin hood tables are rehashed on the calling thread")
+	{
+		hash_map<int, int, std::hash<int>, std::equal_to<int>, hash_map_probing::robin_hood> map{};
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		std::size_t calls = 0;
+		map.rehash(8192, 4, reverse_parallel_for{ &calls });
+
+		REQUIRE(calls == 0);
+		REQUIRE(map.capacity() == 8192);
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			REQUIRE(map.find(i)->value == i);
+		}
+	}
+}
+
+// pairs with 60000 distinct keys, every key appearing once or twice
+static std::vector<std::pair<int, int>> build_input()
+{
+	std::vector<std::pair<int, int>> input{};
+
+	for(auto i = 0; i < 100000; ++i)
+	{
+		input.emplace_back(i % 60000, i);
+	}
+
+	std::shuffle(input.begin(), input.end(), std::mt19937{ 7 });
+	return input;
+}
+
+template<typename Map, typename OnDuplicate>
+void check_parallel_build(Map map, OnDuplicate on_duplicate)
+{
+	const auto input = build_input();
+	std::unordered_map<int, int> reference{};
+
+	for(auto i = 0; i < 1000; ++i)
+	{
+		map.insert(-i, i);
+		reference.emplace(-i, i);
+	}
+
+	for(auto i = 1; i < 1000; i += 2)
+	{
+		map.erase(-i);
+		reference.erase(-i);
+	}
+
+	for(const auto& [key, value] : input)
+	{
+		const auto [iter, inserted] = reference.emplace(key, value);
+		if(!inserted) on_duplicate(iter->second, value);
+	}
+
+	map.build_parallel(input.begin(), input.end(), 4, on_duplicate);
+
+	REQUIRE(map.size() == reference.size());
+
+	for(const auto& [key, value] : reference)
+	{
+		REQUIRE(map.find(key)->value == value);
+	}
+}
+
+// keeps the last value by way of scratch state that a shared combiner would race on
+struct keep_last_buffered
+{
+	std::vector<int> buffer{};
+
+	void operator()(int& existing, int duplicate)
+	{
+		buffer.push_back(duplicate);
+		existing = buffer.back();
+	}
+};
+
+TEST_CASE("hash map parallel build", "[hash_map]")
+{
+	const auto sum = [](int& existing, int duplicate) { existing += duplicate; };
+
+	SECTION("the last value of a key wins by default")
+	{
+		check_parallel_build(hash_map<int, int>{}, hash_map_duplicates::keep_last{});
+	}
+
+	SECTION("the first value of a key can be kept")
+	{
+		check_parallel_build(hash_map<int, int>{}, hash_map_duplicates::keep_first{});
+	}
+
+	SECTION("values of a key can be combined")
+	{
+		check_parallel_build(hash_map<int, int>{}, sum);
+	}
+
+	SECTION("colliding keys")
+	{
+		check_parallel_build(hash_map<int, int, clustering_hash>{}, sum);
+	}
+
+	SECTION("every thread merges with its own copy of the combiner")
+	{
+		check_parallel_build(hash_map<int, int>{}, keep_last_buffered{});
+	}
+
+	SECTION("robin hood tables are built on the calling thread")
+	{
+		check_parallel_build(hash_map<int, int, std::hash<int>, std::equal_to<int>, hash_map_probing::robin_hood>{}, sum);
+	}
+
+	SECTION("string keys")
+	{
+		std::vector<std::pair<std::string, int>> input{};
+
+		for(const auto& [key, value] : build_input())
+		{
+			input.emplace_back(std::to_string(key), value);
+		}
+
+		hash_map<std::string, int> map{};
+		map.build_parallel(input.begin(), input.end(), 4);
+
+		REQUIRE(map.size() == 60000);
+
+		for(const auto& [key, value] : input)
+		{
+			REQUIRE(map.contains(key));
+		}
+
+		REQUIRE(map.find(input.back().first)->value == input.back().second);
+	}
+}
+
+TEST_CASE("hash map parallel iteration", "[hash_map]")
+{
+	SECTION("slot ranges hold every element once")
+	{
+		hash_map<int, int> map{};
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		for(const auto parts : { 1, 3, 7, 5000 })
+		{
+			const auto ranges = static_cast<const hash_map<int, int>&>(map).slot_ranges(parts);
+			REQUIRE(ranges.size() == std::size_t(parts));
+
+			std::vector<int> keys{};
+
+			for(const auto& range : ranges)
+			{
+				for(const auto& element : range)
+				{
+					keys.push_back(element.key);
+				}
+			}
+
+			std::sort(keys.begin(), keys.end());
+
+			REQUIRE(keys.size() == 1000);
+			REQUIRE(std::adjacent_find(keys.begin(), keys.end()) == keys.end());
+		}
+	}
+
+	SECTION("slot ranges cover both tables while growing incrementally")
+	{
+		hash_map<int, int, std::hash<int>, std::equal_to<int>, hash_map_probing::tombstones, incremental_growth_policy> map{};
+		auto inserted = 0;
+
+		while(!map.rehashing())
+		{
+			map.insert(inserted, inserted);
+			++inserted;
+		}
+
+		const auto ranges = map.slot_ranges(4);
+		REQUIRE(ranges.size() == 8);
+
+		std::ptrdiff_t elements = 0;
+
+		for(const auto& range : ranges)
+		{
+			elements += std::distance(range.begin(), range.end());
+		}
+
+		REQUIRE(elements == inserted);
+	}
+
+	SECTION("for_each_parallel visits every element once")
+	{
+		hash_map<int, int> map{};
+
+		for(auto i = 0; i < 100000; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		map.for_each_parallel(4, [](hash_map<int, int>::key_value_pair& element) { element.value *= 2; });
+
+		std::atomic<long long> sum{ 0 };
+		static_cast<const hash_map<int, int>&>(map).for_each_parallel(4, [&](const auto& element) { sum += element.value; });
+
+		REQUIRE(sum == 2 * (100000ll * 99999 / 2));
+	}
+
+	SECTION("for_each runs on the given parallel_for and rethrows exceptions")
+	{
+		hash_map<int, int> map{};
+
+		for(auto i = 0; i < 100; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		std::size_t calls = 0;
+		auto visited = 0;
+
+		map.for_each(3, reverse_parallel_for{ &calls }, [&](const auto&) { ++visited; });
+
+		REQUIRE(calls == 1);
+		REQUIRE(visited == 100);
+
+		REQUIRE_THROWS_AS(map.for_each(3, reverse_parallel_for{ &calls }, [](const auto& element) { if(element.key == 50) throw std::runtime_error{ "stop" }; }), std::runtime_error);
+	}
+}
+
+TEST_CASE("hash map statistics", "[hash_map]")
+{
+	SECTION("an empty map")
+	{
+		const hash_map<int, int> map{};
+		const auto stats = map.stats();
+
+		REQUIRE(stats.size == 0);
+		REQUIRE(stats.capacity == map.capacity());
+		REQUIRE(stats.probe_histogram.empty());
+		REQUIRE(stats.longest_cluster == 0);
+		REQUIRE(stats.load_factor == 0.0);
+		REQUIRE(stats.bytes_per_element == 0.0);
+		REQUIRE(stats.allocated_bytes > 0);
+	}
+
+	SECTION("colliding keys show up as long probe distances and clusters")
+	{
+		hash_map<int, int> spread{};
+		hash_map<int, int, clustering_hash> clustered{};
+
+		for(auto i = 0; i < 2000; ++i)
+		{
+			spread.insert(i, i);
+			clustered.insert(i, i);
+		}
+
+		const auto good = spread.stats();
+		const auto bad = clustered.stats();
+
+		for(const auto& stats : { good, bad })
+		{
+			std::size_t elements = 0;
+
+			for(const auto count : stats.probe_histogram)
+			{
+				elements += count;
+			}
+
+			REQUIRE(elements == 2000);
+			REQUIRE(stats.probe_histogram.back() > 0);
+			REQUIRE(stats.bytes_per_element == double(stats.allocated_bytes) / 2000);
+		}
+
+		REQUIRE(bad.mean_probe_distance > 10 * good.mean_probe_distance);
+		REQUIRE(bad.longest_cluster > 4 * good.longest_cluster);
+	}
+
+	SECTION("tombstones raise the effective load")
+	{
+		hash_map<int, int, clustering_hash> map{};
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			map.insert(i, i);
+		}
+
+		for(auto i = 0; i < 1000; i += 2)
+		{
+			map.erase(i);
+		}
+
+		const auto stats = map.stats();
+
+		REQUIRE(stats.size == 500);
+		REQUIRE(stats.tombstones == map.tombstone_count());
+		REQUIRE(stats.tombstones > 0);
+		REQUIRE(stats.load_factor == map.load_factor());
+		REQUIRE(stats.effective_load_factor == double(500 + stats.tombstones) / map.capacity());
+	}
+
+	SECTION("both tables count while growing incrementally")
+	{
+		hash_map<int, int, std::hash<int>, std::equal_to<int>, hash_map_probing::tombstones, incremental_growth_policy> map{};
+		auto inserted = 0;
+
+		while(!map.rehashing())
+		{
+			map.insert(inserted, inserted);
+			++inserted;
+		}
+
+		const auto stats = map.stats();
+		std::size_t elements = 0;
+
+		for(const auto count : stats.probe_histogram)
+		{
+			elements += count;
+		}
+
+		REQUIRE(elements == std::size_t(inserted));
+		REQUIRE(stats.allocated_bytes > map.capacity() * (sizeof(int) * 2 + 1));
+	}
+}
+
+static int hash_calls = 0;
+
+struct counting_string_hash
+{
+	std::size_t operator()(const std::string& key) const noexcept
+	{
+		++hash_calls;
+		return std::hash<std::string>{}(key);
+	}
+};
+
+TEST_CASE("hash map with stored hashes", "[hash_map]")
+{
+	static_assert(hash_map_store_hash<std::string>::value, "string keys store their hashes by default");
+	static_assert(!hash_map_store_hash<int>::value, "int keys do not store their hashes by default");
+
+	hash_calls = 0;
+	hash_map<std::string, int, counting_string_hash> map{};
+
+	for(auto i = 0; i < 1000; ++i)
+	{
+		map.insert(std::to_string(i), i);
+	}
+
+	SECTION("growing the table does not hash any key again")
+	{
+		// lookup and insertion share a single hash per key
+		REQUIRE(hash_calls == 1000);
+	}
+
+	SECTION("all keys can be found")
+	{
+		for(auto i = 0; i < 1000; ++i)
+		{
+			REQUIRE(map.find(std::to_string(i))->value == i);
+		}
+
+		REQUIRE(map.find("1000") == map.end());
+	}
+
+	SECTION("purging keeps the stored hashes intact")
+	{
+		for(auto i = 0; i < 1000; i += 2)
+		{
+			map.erase(std::to_string(i));
+		}
+
+		map.purge();
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			REQUIRE((map.find(std::to_string(i)) != map.end()) == (i % 2 == 1));
+		}
+	}
+
+	SECTION("batched inserts hash every key once")
+	{
+		std::vector<std::pair<std::string, int>> batch{};
+
+		for(auto i = 500; i < 1500; ++i)
+		{
+			batch.emplace_back(std::to_string(i), -i);
+		}
+
+		hash_calls = 0;
+		map.insert_batch(batch.begin(), batch.end());
+
+		REQUIRE(hash_calls == 1000);
+		REQUIRE(map.size() == 1500u);
+		REQUIRE(map.find("499")->value == 499);
+		REQUIRE(map.find("500")->value == -500);
+		REQUIRE(map.find("1499")->value == -1499);
+	}
+}
+
+struct transparent_string_hash
+{
+	using is_transparent = void;
+
+	std::size_t operator()(std::string_view key) const noexcept { return std::hash<std::string_view>{}(key); }
+};
+
+TEST_CASE("hash map with heterogeneous lookup", "[hash_map]")
+{
+	hash_map<std::string, int, transparent_string_hash, std::equal_to<>> map{};
+	const auto& cmap = map;
+
+	map.insert("one", 1);
+	map.insert("two", 2);
+
+	SECTION("elements can be found by string_view and string literals")
+	{
+		REQUIRE(map.find(std::string_view{ "one" })->value == 1);
+		REQUIRE(cmap.find(std::string_view{ "two" })->value == 2);
+		REQUIRE(map.find("two")->value == 2);
+		REQUIRE(map.find(std::string_view{ "three" }) == map.end());
+	}
+
+	SECTION("contains accepts compatible keys")
+	{
+		REQUIRE(map.contains(std::string_view{ "one" }));
+		REQUIRE(map.contains(std::string{ "two" }));
+		REQUIRE(!map.contains("three"));
+	}
+
+	SECTION("batched lookups accept compatible keys")
+	{
+		const std::string_view keys[] = { "one", "three", "two" };
+		bool hits[3];
+
+		map.contains_many(std::begin(keys), std::end(keys), hits);
+
+		REQUIRE(hits[0]);
+		REQUIRE(!hits[1]);
+		REQUIRE(hits[2]);
+	}
+
+	SECTION("elements can be erased by compatible keys")
+	{
+		map.erase(std::string_view{ "one" });
+
+		REQUIRE(map.size() == 1u);
+		REQUIRE(!map.contains("one"));
+	}
+
+	SECTION("try_emplace only inserts missing keys")
+	{
+		auto [existing, inserted_existing] = map.try_emplace(std::string_view{ "one" }, 10);
+		REQUIRE(!inserted_existing);
+		REQUIRE(existing->value == 1);
+
+		auto [added, inserted_added] = map.try_emplace(std::string_view{ "three" }, 3);
+		REQUIRE(inserted_added);
+		REQUIRE(added->key == "three");
+		REQUIRE(map.find("three")->value == 3);
+	}
+}
+
+struct counted_key
+{
+	static int copies;
+	static int moves;
+
+	int id;
+
+	explicit counted_key(int key) noexcept : id(key) {}
+	counted_key(const counted_key& other) noexcept : id(other.id) { ++copies; }
+	counted_key(counted_key&& other) noexcept : id(other.id) { ++moves; }
+};
+
+int counted_key::copies = 0;
+int counted_key::moves = 0;
+
+struct counted_key_hash
+{
+	std::size_t operator()(const counted_key& key) const noexcept { return std::hash<int>{}(key.id); }
+};
+
+struct counted_key_equal
+{
+	bool operator()(const counted_key& lhs, const counted_key& rhs) const noexcept { return lhs.id == rhs.id; }
+};
+
+TEST_CASE("hash map key passing", "[hash_map]")
+{
+	hash_map<counted_key, int, counted_key_hash, counted_key_equal> map{};
+
+	counted_key::copies = 0;
+	counted_key::moves = 0;
+
+	SECTION("inserting an lvalue key copies it exactly once")
+	{
+		const counted_key key{ 1 };
+		map.insert(key, 1);
+
+		REQUIRE(counted_key::copies == 1);
+		REQUIRE(counted_key::moves == 0);
+	}
+
+	SECTION("inserting an rvalue key moves it exactly once")
+	{
+		map.emplace(counted_key{ 2 }, 2);
+
+		REQUIRE(counted_key::copies == 0);
+		REQUIRE(counted_key::moves == 1);
+	}
+
+	SECTION("lookups do not copy keys")
+	{
+		map.emplace(counted_key{ 3 }, 3);
+		counted_key::moves = 0;
+
+		REQUIRE(map.find(counted_key{ 3 })->value == 3);
+		REQUIRE(map.contains(counted_key{ 3 }));
+		map.erase(counted_key{ 3 });
+
+		REQUIRE(counted_key::copies == 0);
+		REQUIRE(counted_key::moves == 0);
+	}
+
+	SECTION("keys hashed beforehand are passed along with their hash")
+	{
+		const auto key_hash = hash_map_detail::hash_key(counted_key_hash{}, counted_key{ 4 });
+
+		REQUIRE(map.try_emplace_hashed(key_hash, counted_key{ 4 }, 4).second);
+		REQUIRE_FALSE(map.try_emplace_hashed(key_hash, counted_key{ 4 }, 5).second);
+		REQUIRE_FALSE(map.insert_or_assign_hashed(key_hash, counted_key{ 4 }, 6).second);
+
+		REQUIRE(map.find(counted_key{ 4 }, key_hash)->value == 6);
+		REQUIRE(map.contains(counted_key{ 4 }, key_hash));
+		REQUIRE(map.find(counted_key{ 4 })->value == 6);
+		REQUIRE(counted_key::moves == 1);
+
+		const auto other_hash = hash_map_detail::hash_key(counted_key_hash{}, counted_key{ 5 });
+		REQUIRE(map.insert_or_assign_hashed(other_hash, counted_key{ 5 }, 5).second);
+		REQUIRE(map.find(counted_key{ 5 })->value == 5);
+		REQUIRE(static_cast<const decltype(map)&>(map).find(counted_key{ 6 }, hash_map_detail::hash_key(counted_key_hash{}, counted_key{ 6 })) == map.cend());
+	}
+
+	SECTION("the key comparison decides which keys are equal")
+	{
+		struct last_digit_hash
+		{
+			std::size_t operator()(int key) const noexcept { return std::size_t(key % 10); }
+		};
+
+		struct last_digit_equal
+		{
+			bool operator()(int lhs, int rhs) const noexcept { return lhs % 10 == rhs % 10; }
+		};
+
+		hash_map<int, int, last_digit_hash, last_digit_equal> digit_map{};
+		digit_map.insert(1, 2);
+		digit_map.insert(11, 3);
+
+		REQUIRE(digit_map.size() == 1u);
+		REQUIRE(digit_map.find(21)->value == 3);
+	}
 }
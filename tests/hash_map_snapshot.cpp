@@ -0,0 +1,192 @@
+#include "catch.hpp"
+#include "hash_map_snapshot.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace
+{
+	using snapshot_map = hash_map<int, double>;
+
+	struct snapshot_file
+	{
+		std::string path = "hash_map_snapshot_test.bin";
+		~snapshot_file() { std::remove(path.c_str()); }
+	};
+}
+
+TEST_CASE("hash map snapshots", "[hash_map_snapshot]")
+{
+	snapshot_file file{};
+	snapshot_map map{};
+
+	for(auto i = 0; i < 10000; ++i)
+	{
+		map.insert(i, i * 0.5);
+	}
+
+	for(auto i = 0; i < 10000; i += 3)
+	{
+		map.erase(i);
+	}
+
+	SECTION("a view finds exactly the elements of the saved map")
+	{
+		save_snapshot(map, file.path);
+
+		const hash_map_view<snapshot_map> view{ file.path };
+
+		REQUIRE(view.size() == map.size());
+		REQUIRE(view.capacity() == map.capacity());
+
+		for(auto i = -10; i < 10010; ++i)
+		{
+			const auto element = view.find(i);
+			const auto expected = map.find(i);
+
+			REQUIRE((element != nullptr) == (expected != map.end()));
+			if(element != nullptr) REQUIRE(element->value == expected->value);
+		}
+	}
+
+	SECTION("robin hood maps and maps in the middle of incremental growth can be saved")
+	{
+		using robin_hood_map = hash_map<int, int, std::hash<int>, std::equal_to<int>, hash_map_probing::robin_hood>;
+
+		auto growth = hash_map_growth_policy{};
+		growth.incremental_step = 1;
+
+		robin_hood_map other{ growth };
+
+		for(auto i = 0; !other.rehashing() || i < 1000; ++i)
+		{
+			other.insert(i, -i);
+		}
+
+		REQUIRE(other.rehashing());
+		hash_map_view<robin_hood_map>::save(other, file.path);
+
+		const hash_map_view<robin_hood_map> view{ file.path };
+
+		REQUIRE(view.size() == other.size());
+
+		for(const auto& element : other)
+		{
+			REQUIRE(view.find(element.key)->value == element.value);
+		}
+	}
+
+	SECTION("a moved-from map is saved as an empty table")
+	{
+		const auto moved = std::move(map);
+		save_snapshot(map, file.path);
+
+		const hash_map_view<snapshot_map> view{ file.path };
+
+		REQUIRE(view.empty());
+		REQUIRE(view.capacity() > 0);
+		REQUIRE_FALSE(view.contains(1));
+	}
+
+	SECTION("files that do not match the map are rejected")
+	{
+		save_snapshot(map, file.path);
+
+		REQUIRE_THROWS_AS((hash_map_view<hash_map<int, float>>{ file.path }), std::runtime_error);
+		REQUIRE_THROWS_AS(hash_map_view<snapshot_map>{ "no_such_snapshot.bin" }, std::runtime_error);
+
+		{
+			std::ofstream out{ file.path, std::ios::binary | std::ios::trunc };
+			out << "not a snapshot at all, just some text that is long enough for a header";
+		}
+
+		REQUIRE_THROWS_AS(hash_map_view<snapshot_map>{ file.path }, std::runtime_error);
+	}
+
+	SECTION("saving over a file that is mapped leaves existing views intact")
+	{
+		save_snapshot(map, file.path);
+		const hash_map_view<snapshot_map> view{ file.path };
+
+		snapshot_map small{};
+		small.insert(1, 1.5);
+		save_snapshot(small, file.path);
+
+		REQUIRE(view.size() == map.size());
+		REQUIRE(view.find(9998)->value == 4999);
+		REQUIRE_FALSE(view.contains(9999));
+
+		const hash_map_view<snapshot_map> replaced{ file.path };
+		REQUIRE(replaced.size() == 1u);
+		REQUIRE(replaced.find(1)->value == 1.5);
+	}
+
+	SECTION("files written with a different hash width are rejected")
+	{
+		save_snapshot(map, file.path);
+
+		{
+			std::fstream io{ file.path, std::ios::binary | std::ios::in | std::ios::out };
+			hash_map_detail::snapshot_header header{};
+			io.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+			header.hash_size = sizeof(std::size_t) == 8 ? 4 : 8;
+
+			io.seekp(0);
+			io.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		}
+
+		REQUIRE_THROWS_AS(hash_map_view<snapshot_map>{ file.path }, std::runtime_error);
+	}
+
+	SECTION("headers with an impossible capacity are rejected")
+	{
+		save_snapshot(map, file.path);
+
+		// rewrites the capacity together with the slot offset that follows from it, so that only the
+		// capacity itself can give the file away
+		const auto corrupt = [&](std::uint64_t capacity) {
+			std::fstream io{ file.path, std::ios::binary | std::ios::in | std::ios::out };
+			hash_map_detail::snapshot_header header{};
+			io.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+			header.capacity = capacity;
+			header.size = std::min<std::uint64_t>(header.size, capacity);
+			header.slots_offset = hash_map_detail::snapshot_align(header.control_offset + capacity);
+
+			io.seekp(0);
+			io.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		};
+
+		corrupt(0);
+		REQUIRE_THROWS_AS(hash_map_view<snapshot_map>{ file.path }, std::runtime_error);
+
+		corrupt(hash_map_detail::group::width / 2);
+		REQUIRE_THROWS_AS(hash_map_view<snapshot_map>{ file.path }, std::runtime_error);
+
+		corrupt(3 * hash_map_detail::group::width);
+		REQUIRE_THROWS_AS(hash_map_view<snapshot_map>{ file.path }, std::runtime_error);
+
+		// slots_offset + capacity * sizeof(slot) wraps around to a small number
+		corrupt(std::uint64_t(1) << 62);
+		REQUIRE_THROWS_AS(hash_map_view<snapshot_map>{ file.path }, std::runtime_error);
+	}
+
+	SECTION("padding in the slots is written as zeros")
+	{
+		// int keys with double values leave padding between key and value in every slot
+		save_snapshot(map, file.path);
+
+		const hash_map_view<snapshot_map> view{ file.path };
+
+		for(const auto& expected : map)
+		{
+			const auto element = view.find(expected.key);
+			const auto padding = reinterpret_cast<const char*>(&element->key) + sizeof(int);
+
+			REQUIRE(std::all_of(padding, reinterpret_cast<const char*>(&element->value), [](char byte) { return byte == 0; }));
+		}
+	}
+}
@@ -0,0 +1,96 @@
+#include "catch.hpp"
+#include "huge_page_allocator.hpp"
+#include "hash_map.hpp"
+#include <cstdint>
+
+TEST_CASE("huge page allocator", "[huge_page_allocator]")
+{
+	SECTION("small and large blocks are usable")
+	{
+		huge_page_allocator<std::uint64_t> allocator{};
+
+		for(const std::size_t n : { std::size_t(16), huge_pages::page_size / 8, huge_pages::page_size })
+		{
+			auto block = allocator.allocate(n);
+
+			for(std::size_t i = 0; i < n; ++i)
+			{
+				block[i] = i;
+			}
+
+			REQUIRE(block[n - 1] == n - 1);
+			allocator.deallocate(block, n);
+		}
+	}
+
+#if defined(__linux__)
+	SECTION("large blocks start on a huge page boundary")
+	{
+		huge_page_allocator<char> allocator{};
+		auto block = allocator.allocate(3 * huge_pages::page_size + 1);
+
+		REQUIRE(reinterpret_cast<std::uintptr_t>(block) % huge_pages::page_size == 0u);
+		allocator.deallocate(block, 3 * huge_pages::page_size + 1);
+	}
+
+	SECTION("large blocks grow without losing their contents or alignment")
+	{
+		huge_page_allocator<std::uint64_t> allocator{};
+		const auto n = huge_pages::page_size / 8;
+
+		auto block = allocator.allocate(n);
+
+		for(std::size_t i = 0; i < n; ++i)
+		{
+			block[i] = i;
+		}
+
+		// another mapping right behind the block forces its pages to move
+		auto neighbour = allocator.allocate(n);
+		block = allocator.reallocate(block, n, 4 * n);
+
+		REQUIRE(block != nullptr);
+		REQUIRE(reinterpret_cast<std::uintptr_t>(block) % huge_pages::page_size == 0u);
+
+		for(std::size_t i = 0; i < n; ++i)
+		{
+			REQUIRE(block[i] == i);
+		}
+
+		block[4 * n - 1] = 1;
+		allocator.deallocate(block, 4 * n);
+		allocator.deallocate(neighbour, n);
+
+		auto small = allocator.allocate(16);
+		REQUIRE(allocator.reallocate(small, 16, 32) == nullptr);
+		allocator.deallocate(small, 16);
+	}
+
+	SECTION("reserved huge pages fall back to transparent ones")
+	{
+		huge_page_allocator<char, huge_pages::reserved> allocator{};
+		auto block = allocator.allocate(huge_pages::page_size);
+
+		block[huge_pages::page_size - 1] = 1;
+		allocator.deallocate(block, huge_pages::page_size);
+	}
+#endif
+
+	SECTION("a hash map can keep its table on huge pages")
+	{
+		hash_map<int, int, std::hash<int>, std::equal_to<int>, hash_map_probing::tombstones, hash_map_growth_policy, huge_page_allocator<std::pair<const int, int>>> map{};
+
+		for(auto i = 0; i < 500000; ++i)
+		{
+			map.insert(i, -i);
+		}
+
+		REQUIRE(map.capacity() * 8 >= huge_pages::page_size);
+		REQUIRE(map.tombstone_count() == 0u);
+
+		for(auto i = 0; i < 500000; ++i)
+		{
+			REQUIRE(map.find(i)->value == -i);
+		}
+	}
+}
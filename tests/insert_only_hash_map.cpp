@@ -0,0 +1,87 @@
+#include "catch.hpp"
+#include "insert_only_hash_map.hpp"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("insert only hash map", "[insert_only_hash_map]")
+{
+	SECTION("single threaded use behaves like a hash map")
+	{
+		insert_only_hash_map<std::string, int> map{ 100 };
+
+		REQUIRE(map.insert(std::string{ "one" }, 1).second);
+		REQUIRE(!map.insert(std::string{ "one" }, 10).second);
+		REQUIRE(map.try_emplace(std::string{ "two" }, 2).first->value == 2);
+
+		REQUIRE(map.find("one")->value == 1);
+		REQUIRE(map.find("three") == nullptr);
+		REQUIRE(map.size() == 2u);
+	}
+
+	SECTION("a full map rejects inserts")
+	{
+		insert_only_hash_map<int, int> map{ 8 };
+
+		REQUIRE_THROWS_AS([&] {
+			for(auto i = 0; i < 1000; ++i)
+			{
+				map.insert(i, i);
+			}
+		}(), std::length_error);
+
+		REQUIRE(map.size() < map.capacity());
+	}
+
+	SECTION("concurrent interning inserts every key exactly once")
+	{
+		constexpr auto threads = 8;
+		constexpr auto keys = 20000;
+
+		insert_only_hash_map<std::string, int> map{ keys };
+		std::atomic<int> inserted{ 0 };
+		std::vector<std::vector<const void*>> interned(threads);
+		std::vector<std::thread> workers{};
+
+		for(auto t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&, t] {
+				// every thread interns all keys, starting at a different offset
+				for(auto i = 0; i < keys; ++i)
+				{
+					const auto key = (i + t * keys / threads) % keys;
+					const auto [element, added] = map.try_emplace(std::to_string(key), key);
+
+					if(added) ++inserted;
+					interned[t].push_back(element);
+				}
+			});
+		}
+
+		for(auto& worker : workers)
+		{
+			worker.join();
+		}
+
+		REQUIRE(inserted == keys);
+		REQUIRE(map.size() == std::size_t(keys));
+
+		for(auto t = 0; t < threads; ++t)
+		{
+			for(auto i = 0; i < keys; ++i)
+			{
+				const auto key = (i + t * keys / threads) % keys;
+				REQUIRE(interned[t][i] == map.find(std::to_string(key)));
+			}
+		}
+
+		auto visited = 0;
+		map.for_each([&](const auto& element) {
+			REQUIRE(element.key == std::to_string(element.value));
+			++visited;
+		});
+
+		REQUIRE(visited == keys);
+	}
+}
@@ -0,0 +1,99 @@
+#include "catch.hpp"
+#include "read_mostly_hash_map.hpp"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("read mostly hash map", "[read_mostly_hash_map]")
+{
+	SECTION("single threaded use behaves like a hash map")
+	{
+		read_mostly_hash_map<std::string, int> map{};
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			REQUIRE(map.insert(std::to_string(i), i));
+		}
+
+		REQUIRE(!map.insert(std::string{ "7" }, 70));
+		REQUIRE(map.size() == 1000u);
+		REQUIRE(map.find("7") == 70);
+		REQUIRE(!map.find("1000"));
+
+		for(auto i = 0; i < 1000; i += 2)
+		{
+			REQUIRE(map.erase(std::to_string(i)));
+		}
+
+		REQUIRE(!map.erase("0"));
+		REQUIRE(map.size() == 500u);
+
+		for(auto i = 0; i < 1000; ++i)
+		{
+			REQUIRE(map.contains(std::to_string(i)) == (i % 2 == 1));
+		}
+
+		auto seen = 0;
+		REQUIRE(map.visit("999", [&](const int& value) { seen = value; }));
+		REQUIRE(seen == 999);
+	}
+
+	SECTION("readers see consistent values while a writer replaces, erases and grows")
+	{
+		constexpr auto keys = 256;
+
+		read_mostly_hash_map<int, std::vector<int>> map{};
+
+		for(auto key = 0; key < keys; ++key)
+		{
+			map.insert(key, std::vector<int>(4, key));
+		}
+
+		std::atomic<bool> done{ false };
+		std::atomic<int> torn{ 0 };
+		std::vector<std::thread> readers{};
+
+		for(auto r = 0; r < 4; ++r)
+		{
+			readers.emplace_back([&] {
+				while(!done.load())
+				{
+					for(auto key = 0; key < keys; ++key)
+					{
+						map.visit(key, [&](const std::vector<int>& value) {
+							for(auto element : value)
+							{
+								if(element != value.front()) ++torn;
+							}
+						});
+					}
+				}
+			});
+		}
+
+		for(auto round = 1; round <= 200; ++round)
+		{
+			for(auto key = 0; key < keys; ++key)
+			{
+				map.insert(key, std::vector<int>(4, round));
+			}
+
+			map.erase(round % keys);
+			map.insert(keys + round, std::vector<int>(4, round));
+		}
+
+		done = true;
+
+		for(auto& reader : readers)
+		{
+			reader.join();
+		}
+
+		epoch_domain::instance().reclaim();
+
+		REQUIRE(torn == 0);
+		REQUIRE(map.size() == std::size_t(keys - 1 + 200));
+		REQUIRE(map.find(keys + 200) == std::vector<int>(4, 200));
+	}
+}